@@ -11,6 +11,9 @@
 #include "utils.h"
 #include "logSpeed.h"
 #include "aioRequests.h"
+#include "probes.h"
+#include "ioEngine.h"
+#include "positionLog.h"
 
 extern volatile int keepRunning;
 
@@ -33,7 +36,8 @@ size_t aioMultiplePositions( positionContainer *p,
 			     const size_t oneShot,
 			     const int dontExitOnErrors,
 			     const int fd,
-			     int flushEvery
+			     int flushEvery,
+			     ioEngineType *ioe
 			     ) {
   int ret;
   struct iocb **cbs;
@@ -53,11 +57,8 @@ size_t aioMultiplePositions( positionContainer *p,
   
 
 
-  io_context_t ioc = 0;
-  if (io_setup(QD, &ioc)) {
-    fprintf(stderr,"*error* io_setup failed with %zd\n", QD);
-    exit(-2);
-  }
+  // the job's engine, opened once by jobSetupThreads with room for QD
+  const int readsReturnData = ioEngineReturnsData(ioe);
   
   assert(QD);
   if (!alignment) alignment=512;
@@ -71,7 +72,7 @@ size_t aioMultiplePositions( positionContainer *p,
 
   if (verbose >= 1) {
     for (size_t i = 0; i < 1; i++) {
-      fprintf(stderr,"*info* io_context[%zd] = %p\n", i, (void*)ioc);
+      fprintf(stderr,"*info* io_context[%zd] = %p (%s)\n", i, (void*)ioe->ioc, ioEngineName(ioe->kind));
     }
   }
   
@@ -132,7 +133,8 @@ size_t aioMultiplePositions( positionContainer *p,
 
   size_t inFlight = 0, pos = 0;
 
-  double start = timesec();
+  // sub-second times, the submit/finish times are used for the latency stats
+  double start = timedouble();
   double last = start, lastsubmit =start, lastreceive = start;
   logSpeedReset(benchl);
   logSpeedReset(alll);
@@ -150,12 +152,39 @@ size_t aioMultiplePositions( positionContainer *p,
   double thistime = 0;
   int qdIndex = 0;
 
-  while (keepRunning && ((thistime = timesec()) < finishtime)) {
-    if (inFlight < QD) {
+  // the control socket's rate limit, counted from when it was last changed
+  double rate = 0, rateStart = start;
+  size_t rateSubmitted = 0;
+  p->control.maxQueueDepth = QD;
+
+  while (keepRunning && ((thistime = timedouble()) < finishtime)) {
+    if (p->control.stop) {
+      break; // the in flight I/Os are received below
+    }
+    size_t curQD = QD;
+    if (p->control.queueDepth && p->control.queueDepth < QD) {
+      curQD = p->control.queueDepth;
+    }
+    int submitCycles = (inFlight < curQD && !p->control.paused) ? curQD - inFlight : 0;
+    if (p->control.rate != rate) {
+      rate = p->control.rate;
+      rateStart = thistime;
+      rateSubmitted = submitted;
+    }
+    if (rate > 0 && submitCycles) {
+      const double allowed = floor(rate * (thistime - rateStart)) + 1 - (submitted - rateSubmitted);
+      if (allowed < submitCycles) {
+	submitCycles = (allowed > 0) ? (int)allowed : 0;
+      }
+    }
+    if (submitCycles == 0 && inFlight == 0) {
+      usleep(100); // paused or rate limited, nothing to wait for
+      continue;
+    }
+
+    if (submitCycles) {
       
       // submit requests, one at a time
-      //      fprintf(stderr,"max %zd\n", MAX(QD - inFlight, 1));
-      int submitCycles = MAX(QD - inFlight, 1);
       if (flushEvery) {
 	if (flushEvery < submitCycles) {
 	  submitCycles = flushEvery;
@@ -191,7 +220,7 @@ size_t aioMultiplePositions( positionContainer *p,
 	    qdIndex = freeQueue[tailOfQueue++]; if (tailOfQueue >= QD + 1) tailOfQueue = 0;
 
 	    // setup the request
-	    if (fd >= 0) {
+	    if (fd >= 0 || !ioEngineUsesDevice(ioe->kind)) {
 	      positions[pos].q = qdIndex;
 
 	      // watermark the block with the position on the device
@@ -203,6 +232,8 @@ size_t aioMultiplePositions( positionContainer *p,
 		
 		p->readBytes += len;
 		p->readIOs++;
+		p->allReadBytes += len;
+		p->allReadIOs++;
 
 		cbs[qdIndex]->data = &positions[pos];
 
@@ -220,6 +251,8 @@ size_t aioMultiplePositions( positionContainer *p,
 
 		p->writtenBytes += len;
 		p->writtenIOs++;
+		p->allWrittenBytes += len;
+		p->allWrittenIOs++;
 
 		cbs[qdIndex]->data = &positions[pos];
 
@@ -227,14 +260,17 @@ size_t aioMultiplePositions( positionContainer *p,
 		flushPos++;
 	      }
 	      
-	      ret = io_submit(ioc, 1, &cbs[qdIndex]);
-	      thistime = timesec();
+	      ret = ioEngineSubmit(ioe, cbs[qdIndex]);
+	      thistime = timedouble();
 	      positions[pos].submittime = thistime;
 
 	      if (ret > 0) {
+		positions[pos].ramp = positionRampSubmit(p, &positions[pos], thistime); // only count what was submitted
 		inFlight++;
+		p->inFlight = inFlight;
 		lastsubmit = thistime; // last good submit
 		submitted++;
+		SPITPROBE(submit, p->jobId, newpos, len, positions[pos].action, qdIndex);
 		if (verbose >= 2 || (newpos & (alignment - 1))) {
 		  fprintf(stderr,"fd %d, pos %zd (%% %zd = %zd ... %s), size %zd, inFlight %zd, QD %zd, submitted %zd, received %zd\n", fd, newpos, alignment, newpos % alignment, (newpos % alignment) ? "NO!!" : "aligned", len, inFlight, QD, submitted, received);
 		}
@@ -287,15 +323,19 @@ size_t aioMultiplePositions( positionContainer *p,
 	  if (verbose >= 2) {
 	    fprintf(stderr,"[%zd] SYNC: calling fsync()\n", pos);
 	  }
-	  double start_f = timesec(); // time and store
+	  double start_f = timedouble(); // time and store
+	  SPITPROBE(flush_start, p->jobId, 0, 0, 'F', -1);
 	  //	  io_prep_fsync(cbs[qdIndex], fd);
-	  fsync(fd);
-	  double elapsed_f = timesec() - start_f;
+	  ioEngineFlush(ioe, fd);
+	  double elapsed_f = timedouble() - start_f;
+	  SPITPROBE(flush_end, p->jobId, 0, 0, 'F', -1);
 
 	  flush_totaltime += (elapsed_f);
 	  flush_count++;
 	  if (elapsed_f < flush_mintime) flush_mintime = elapsed_f;
 	  if (elapsed_f > flush_maxtime) flush_maxtime = elapsed_f;
+	  histogramAdd(&p->flushLatency, elapsed_f);
+	  if (p->ioLog) positionLogRingPushFlush(p->ioLog, start_f, start_f + elapsed_f);
 	}
       }
     }
@@ -303,9 +343,9 @@ size_t aioMultiplePositions( positionContainer *p,
     //    if (inFlight < 5) { // then don't timeout
     //      ret = io_getevents(ioc, 1, QD, events, NULL);
     //    } else {
-      ret = io_getevents(ioc, 1, QD, events, &timeout);
+      ret = ioEngineGetEvents(ioe, 1, QD, events, &timeout);
       //    }
-    lastreceive = timesec(); // last good receive
+    lastreceive = timedouble(); // last good receive
 
     if (ret > 0) {
       // verify it's all ok
@@ -319,10 +359,12 @@ size_t aioMultiplePositions( positionContainer *p,
 	int rescode2 = events[j].res2;
 
 	if ((rescode < 0) || (rescode2 != 0)) { // if return of bytes written or read
+	  SPITPROBEERROR(p->jobId, (const positionType*) events[j].obj->data, rescode);
+	  p->errors++;
 	  if (!printed) {
 	    fprintf(stderr,"*error* AIO failure codes: res=%d (%s) and res2=%d (%s)\n", rescode, strerror(-rescode), rescode2, strerror(-rescode2));
-	    fprintf(stderr,"*error* last successful submission was %.3lf seconds ago\n", timesec() - lastsubmit);
-	    fprintf(stderr,"*error* last successful receive was %.3lf seconds ago\n", timesec() - lastreceive);
+	    fprintf(stderr,"*error* last successful submission was %.3lf seconds ago\n", timedouble() - lastsubmit);
+	    fprintf(stderr,"*error* last successful receive was %.3lf seconds ago\n", timedouble() - lastreceive);
 	  }
 	  printed = 1;
 	  //	  fprintf(stderr,"%ld %s %s\n", events[j].res, strerror(events[j].res2), (char*) my_iocb->u.c.buf);
@@ -331,7 +373,7 @@ size_t aioMultiplePositions( positionContainer *p,
 	  struct iocb *my_iocb = events[j].obj;
 	  positionType *pp = (positionType*) my_iocb->data;
 
-	  if ((pp->verify || pp->action=='W') && (pp->success)) {
+	  if (((pp->verify && readsReturnData) || pp->action=='W') && (pp->success)) {
 	    //	    fprintf(stderr,"[%d] pos %zd verify %d\n", pp->q, pp->pos, pp->verify);
 	    // if we know we have written we can check, or if we have read a previous write
 	    size_t *uucheck , *poscheck;
@@ -353,9 +395,13 @@ size_t aioMultiplePositions( positionContainer *p,
 	
 	  pp->finishtime = lastreceive;
 	  pp->success = 1; // the action has completed
+	  positionRampComplete(p, pp);
+	  if (p->ioLog) positionLogRingPush(p->ioLog, pp);
+	  SPITPROBE(complete, p->jobId, pp->pos, pp->len, pp->action, pp->q);
 	}
       }
       inFlight -= ret;
+      p->inFlight = inFlight;
       received += ret;
     }
     if (ret < 0) {
@@ -374,7 +420,8 @@ size_t aioMultiplePositions( positionContainer *p,
       if (verbose >= 1) {
 	fprintf(stderr,"*info* inflight = %zd\n", inFlight);
       }
-      int ret = io_getevents(ioc, inFlight, inFlight, events, NULL);
+      int ret = ioEngineGetEvents(ioe, inFlight, inFlight, events, NULL);
+      lastreceive = timedouble();
       if (ret > 0) {
 	for (int j = 0; j < ret; j++) {
 	  // TODO refactor into the same code as above
@@ -385,8 +432,12 @@ size_t aioMultiplePositions( positionContainer *p,
 	  
 	  pp->finishtime = lastreceive;
 	  pp->success = 1; // the action has completed
+	  positionRampComplete(p, pp);
+	  if (p->ioLog) positionLogRingPush(p->ioLog, pp);
+	  SPITPROBE(complete, p->jobId, pp->pos, pp->len, pp->action, pp->q);
 	}
 	inFlight -= ret;
+	p->inFlight = inFlight;
       }
     }
   }
@@ -402,7 +453,6 @@ size_t aioMultiplePositions( positionContainer *p,
   free(readdata[0]);
   free(readdata);
   free(freeQueue);
-  io_destroy(ioc);
   
 
   *ios = received;
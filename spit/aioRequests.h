@@ -5,6 +5,7 @@
 
 #include "logSpeed.h"
 #include "positions.h"
+#include "ioEngine.h"
 
 size_t aioMultiplePositions( positionContainer *p,
 			     const size_t sz,
@@ -23,7 +24,8 @@ size_t aioMultiplePositions( positionContainer *p,
 			     const size_t oneShot,
 			     const int dontExitOnErrors,
 			     const int fd,
-			     int flushEvery);
+			     int flushEvery,
+			     ioEngineType *ioe);
 
 int aioVerifyWrites(positionType *positions,
 		    const size_t maxpos,
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "control.h"
+#include "results.h"
+#include "utils.h"
+
+static const char *controlHelp =
+  "stats                  counters, QD, rate and state of each job\n"
+  "histograms [job]       the latency histograms so far, non-zero buckets\n"
+  "pause [job]            stop submitting, the I/O in flight completes\n"
+  "resume [job]\n"
+  "qd [job] n             queue depth, up to the job's starting QD, 0 for that\n"
+  "rate [job] n           n IOPS, 0 for no limit\n"
+  "stop [job]             finish the job as if its time was up\n"
+  "job is a number or 'all', the default\n";
+
+
+// returns 0 if listening
+int controlOpen(controlType *c, const char *path) {
+  memset(c, 0, sizeof(controlType));
+  c->fd = -1;
+  c->client = -1;
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr,"*error* the control socket path '%s' is too long\n", path);
+    return 1;
+  }
+  strcpy(addr.sun_path, path);
+
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path); // from a previous run
+  }
+  c->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (c->fd < 0 || bind(c->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(c->fd, 4) != 0) {
+    perror(path);
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    return 1;
+  }
+  chmod(path, S_IRUSR | S_IWUSR);
+  signal(SIGPIPE, SIG_IGN); // a client going away is an EPIPE
+  c->path = strdup(path);
+  fprintf(stderr,"*info* control socket '%s'\n", path);
+  return 0;
+}
+
+
+static void controlReply(controlType *c, const char *s, const size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t w = write(c->client, s + done, len - done);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      close(c->client);
+      c->client = -1;
+      return;
+    }
+    done += w;
+  }
+}
+
+
+static void controlBuckets(FILE *fp, const histogramType *h) {
+  fprintf(fp, "[");
+  size_t printed = 0;
+  for (size_t b = 0; b < HISTOGRAMBUCKETS; b++) {
+    if (h->bucket[b]) {
+      fprintf(fp, "%s[%zd, %zd, %zd]", printed++ ? ", " : "", histogramBucketLow(b), histogramBucketHigh(b), h->bucket[b]);
+    }
+  }
+  fprintf(fp, "]");
+}
+
+
+static void controlStats(FILE *fp, const controlType *c) {
+  fprintf(fp, "{\"time\": %.3lf, \"jobs\": [", timedouble() - c->start);
+  for (size_t i = 0; i < c->num; i++) {
+    const positionContainer *pc = c->pcs[i];
+    const jobControlType *ctl = &pc->control;
+    const size_t qd = (ctl->queueDepth && ctl->queueDepth < ctl->maxQueueDepth) ? ctl->queueDepth : ctl->maxQueueDepth;
+    fprintf(fp, "%s{\"id\": %zd, \"string\": ", i ? ", " : "", i);
+    resultsJSONString(fp, pc->string ? pc->string : "");
+    fprintf(fp, ", \"readBytes\": %zd, \"readIOs\": %zd, \"writtenBytes\": %zd, \"writtenIOs\": %zd, \"inFlight\": %zd, \"queueDepth\": %zd, \"rate\": %.0lf, \"paused\": %d, \"stopped\": %d}",
+	    pc->readBytes, pc->readIOs, pc->writtenBytes, pc->writtenIOs, pc->inFlight, qd, ctl->rate, ctl->paused, ctl->stop);
+  }
+  fprintf(fp, "]}\n");
+}
+
+
+// a snapshot, copied first as the job keeps adding to them
+static void controlHistograms(FILE *fp, const controlType *c, const size_t from, const size_t to) {
+  histogramType *h;
+  CALLOC(h, 1, sizeof(histogramType));
+  fprintf(fp, "{\"time\": %.3lf, \"jobs\": [", timedouble() - c->start);
+  for (size_t i = from; i < to; i++) {
+    const positionContainer *pc = c->pcs[i];
+    fprintf(fp, "%s{\"id\": %zd, \"read\": ", (i > from) ? ", " : "", i);
+    memcpy(h, &pc->readLatency, sizeof(histogramType));
+    resultsLatencyJSON(fp, h);
+    fprintf(fp, ", \"readBuckets\": ");
+    controlBuckets(fp, h);
+    fprintf(fp, ", \"write\": ");
+    memcpy(h, &pc->writeLatency, sizeof(histogramType));
+    resultsLatencyJSON(fp, h);
+    fprintf(fp, ", \"writeBuckets\": ");
+    controlBuckets(fp, h);
+    fprintf(fp, ", \"flush\": ");
+    memcpy(h, &pc->flushLatency, sizeof(histogramType));
+    resultsLatencyJSON(fp, h);
+    fprintf(fp, "}");
+  }
+  fprintf(fp, "]}\n");
+  free(h);
+}
+
+
+// one command line, the reply is written to fp
+static void controlCommand(controlType *c, char *line, FILE *fp) {
+  char *words[4] = {NULL, NULL, NULL, NULL};
+  size_t n = 0;
+  for (char *save = NULL, *w = strtok_r(line, " \t\r", &save); w && n < 4; w = strtok_r(NULL, " \t\r", &save)) {
+    words[n++] = w;
+  }
+  if (n == 0) {
+    return;
+  }
+  const char *cmd = words[0];
+  const int takesValue = (strcmp(cmd, "qd") == 0 || strcmp(cmd, "rate") == 0);
+
+  // [job] is optional, all by default
+  size_t from = 0, to = c->num, arg = 1;
+  if (words[arg] && (n > arg + (takesValue ? 1 : 0))) {
+    if (strcmp(words[arg], "all") != 0) {
+      char *endp = NULL;
+      const long j = strtol(words[arg], &endp, 10);
+      if (*endp || j < 0 || j >= (long)c->num) {
+	fprintf(fp, "error: no job '%s', there are %zd\n", words[arg], c->num);
+	return;
+      }
+      from = j;
+      to = j + 1;
+    }
+    arg++;
+  }
+  if (takesValue && !words[arg]) {
+    fprintf(fp, "error: %s needs a value\n", cmd);
+    return;
+  }
+
+  if (strcmp(cmd, "help") == 0) {
+    fprintf(fp, "%s", controlHelp);
+  } else if (strcmp(cmd, "stats") == 0) {
+    controlStats(fp, c);
+  } else if (strcmp(cmd, "histograms") == 0) {
+    controlHistograms(fp, c, from, to);
+  } else if (strcmp(cmd, "pause") == 0 || strcmp(cmd, "resume") == 0 || strcmp(cmd, "stop") == 0 || takesValue) {
+    const double value = takesValue ? atof(words[arg]) : 0;
+    if (value < 0) {
+      fprintf(fp, "error: %s can't be negative\n", cmd);
+      return;
+    }
+    for (size_t i = from; i < to; i++) {
+      jobControlType *ctl = &c->pcs[i]->control;
+      if (strcmp(cmd, "pause") == 0) ctl->paused = 1;
+      else if (strcmp(cmd, "resume") == 0) ctl->paused = 0;
+      else if (strcmp(cmd, "stop") == 0) ctl->stop = 1;
+      else if (strcmp(cmd, "qd") == 0) ctl->queueDepth = (size_t)value;
+      else ctl->rate = value;
+    }
+    fprintf(fp, "ok %s %zd job%s\n", cmd, to - from, (to - from == 1) ? "" : "s");
+    fprintf(stderr, "*info* control: %s %zd job%s\n", cmd, to - from, (to - from == 1) ? "" : "s");
+  } else {
+    fprintf(fp, "error: unknown command '%s', try help\n", cmd);
+  }
+}
+
+
+static void controlRead(controlType *c) {
+  char buf[1024];
+  const ssize_t got = read(c->client, buf, sizeof(buf));
+  if (got <= 0) {
+    close(c->client);
+    c->client = -1;
+    return;
+  }
+  for (ssize_t i = 0; i < got && c->client >= 0; i++) {
+    if (buf[i] != '\n') {
+      if (c->lineLen < sizeof(c->line) - 1) c->line[c->lineLen++] = buf[i];
+      continue;
+    }
+    c->line[c->lineLen] = 0;
+    c->lineLen = 0;
+
+    char *reply = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&reply, &len);
+    if (fp) {
+      controlCommand(c, c->line, fp);
+      fclose(fp);
+      controlReply(c, reply, len);
+      free(reply);
+    }
+  }
+}
+
+
+static void *controlThread(void *arg) {
+  controlType *c = (controlType*)arg;
+  while (c->running) {
+    struct pollfd fds[2];
+    fds[0].fd = c->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = c->client;
+    fds[1].events = POLLIN;
+    if (poll(fds, (c->client >= 0) ? 2 : 1, 100) <= 0) {
+      continue;
+    }
+    if (fds[0].revents & POLLIN) {
+      const int client = accept(c->fd, NULL, NULL);
+      if (client >= 0) {
+	if (c->client >= 0) close(c->client); // the newest client wins
+	c->client = client;
+	c->lineLen = 0;
+      }
+    } else if (c->client >= 0 && fds[1].revents) {
+      controlRead(c);
+    }
+  }
+  return NULL;
+}
+
+
+// serve the jobs of a run until controlStop
+void controlStart(controlType *c, positionContainer **pcs, const size_t num) {
+  if (c->fd < 0) {
+    return;
+  }
+  c->pcs = pcs;
+  c->num = num;
+  c->start = timedouble();
+  c->running = 1;
+  pthread_create(&c->thread, NULL, controlThread, c);
+}
+
+
+void controlStop(controlType *c) {
+  if (c->running) {
+    c->running = 0;
+    pthread_join(c->thread, NULL);
+  }
+}
+
+
+void controlClose(controlType *c) {
+  controlStop(c);
+  if (c->client >= 0) {
+    close(c->client);
+    c->client = -1;
+  }
+  if (c->fd >= 0) {
+    close(c->fd);
+    c->fd = -1;
+    unlink(c->path);
+  }
+  free(c->path);
+  c->path = NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef _CONTROL_H
+#define _CONTROL_H
+
+#include <pthread.h>
+
+#include "positions.h"
+
+/* --control path, a Unix domain socket for changing a running spit. One
+ * client at a time, a command per line, see controlHelp. The jobs apply
+ * the changes at their next submission, the I/O in flight isn't drained */
+typedef struct {
+  int fd;                    // listening, -1 if not open
+  int client;                // -1 if none
+  char *path;
+  char line[1024];
+  size_t lineLen;
+  volatile int running;
+  pthread_t thread;
+  positionContainer **pcs;   // the jobs of the current run
+  size_t num;
+  double start;
+} controlType;
+
+int  controlOpen(controlType *c, const char *path);
+void controlStart(controlType *c, positionContainer **pcs, const size_t num);
+void controlStop(controlType *c);
+void controlClose(controlType *c);
+
+#endif
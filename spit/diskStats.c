@@ -6,23 +6,17 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/sysmacros.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
 
 #include "diskStats.h"
 #include "utils.h"
 
 
 void diskStatClear(diskStatType *d) {
-  d->startSecRead = 0;
-  d->startSecWrite = 0;
-  d->startSecTimeio = 0 ;
-  d->startIORead = 0;
-  d->startIOWrite = 0;
-  
-  d->finishSecRead = 0;
-  d->finishSecWrite = 0;
-  d->finishSecTimeio = 0;
-  d->finishIORead = 0;
-  d->finishIOWrite = 0;
+  memset(&d->start, 0, sizeof(diskStatSampleType));
+  memset(&d->finish, 0, sizeof(diskStatSampleType));
 }
   
 void diskStatSetup(diskStatType *d) {
@@ -32,48 +26,143 @@ void diskStatSetup(diskStatType *d) {
   CALLOC(d->majorArray, d->allocDevices, sizeof(int));
   CALLOC(d->minorArray, d->allocDevices, sizeof(int));
   CALLOC(d->sizeArray, d->allocDevices, sizeof(size_t));
+  CALLOC(d->fdArray, d->allocDevices, sizeof(int));
 }
 
 void diskStatAddDrive(diskStatType *d, int fd) {
   unsigned int major = 0, minor = 0;
   majorAndMinor(fd, &major, &minor);
+  diskStatAddDevice(d, major, minor, blockDeviceSizeFromFD(fd));
+}
+
+void diskStatAddDevice(diskStatType *d, const unsigned int major, const unsigned int minor, const size_t size) {
   if (d->numDevices >= d->allocDevices) {
     d->allocDevices += 10;
     d->majorArray = realloc(d->majorArray, d->allocDevices * sizeof(int));
     d->minorArray = realloc(d->minorArray, d->allocDevices * sizeof(int));
     d->sizeArray = realloc(d->sizeArray, d->allocDevices * sizeof(size_t));
+    d->fdArray = realloc(d->fdArray, d->allocDevices * sizeof(int));
   }
   d->majorArray[d->numDevices] = major;
   d->minorArray[d->numDevices] = minor;
-  d->sizeArray[d->numDevices] = blockDeviceSizeFromFD(fd);
+  d->sizeArray[d->numDevices] = size;
+
+  // keep the sysfs stat file open, a sample is then a pread() and no parsing of /proc/diskstats
+  char s[100];
+  sprintf(s, "/sys/dev/block/%u:%u/stat", major, minor);
+  d->fdArray[d->numDevices] = open(s, O_RDONLY);
   //    fprintf(stderr,"diskStatAddDrive fd %d, major %u, minor %u\n", fd, major, minor);
   d->numDevices++;
 }
 
+
+// read a small sysfs file into s, returns the number of bytes
+static int sysfsRead(const char *path, char *s, const size_t len) {
+  FILE *fp = fopen(path, "rt");
+  if (!fp) {
+    return 0;
+  }
+  int ret = fread(s, 1, len - 1, fp);
+  fclose(fp);
+  if (ret < 0) ret = 0;
+  s[ret] = 0;
+  return ret;
+}
+
+/* the block device for a path. A block device is itself, for a regular
+ * file it's the device holding the filesystem. Returns 1 if added */
+int diskStatAddPath(diskStatType *d, const char *path, unsigned int *major, unsigned int *minor) {
+  struct stat buf;
+  if (stat(path, &buf) != 0) {
+    return 0;
+  }
+  const dev_t dt = S_ISBLK(buf.st_mode) ? buf.st_rdev : buf.st_dev;
+  *major = major(dt);
+  *minor = minor(dt);
+
+  char s[PATH_MAX], v[100];
+  sprintf(s, "/sys/dev/block/%u:%u/size", *major, *minor);
+  if (sysfsRead(s, v, 100) == 0) {
+    return 0; // not a real block device, e.g. tmpfs
+  }
+  diskStatAddDevice(d, *major, *minor, 512L * atol(v));
+  return 1;
+}
+
+/* add the bottom level slaves of an md/dm device (md on sd, dm on md on sd ...)
+ * so RAID amplification is measured on the physical devices. Returns the count */
+size_t diskStatAddSlaves(diskStatType *d, const unsigned int major, const unsigned int minor) {
+  char s[PATH_MAX];
+  sprintf(s, "/sys/dev/block/%u:%u/slaves", major, minor);
+  DIR *dir = opendir(s);
+  if (!dir) {
+    return 0;
+  }
+  size_t added = 0;
+  struct dirent *de;
+  while ((de = readdir(dir)) != NULL) {
+    if (de->d_name[0] == '.') continue;
+    char fn[PATH_MAX + 300], v[100];
+    unsigned int mj = 0, mn = 0;
+    snprintf(fn, sizeof(fn), "%s/%s/dev", s, de->d_name);
+    if (sysfsRead(fn, v, 100) == 0 || sscanf(v, "%u:%u", &mj, &mn) != 2) {
+      continue;
+    }
+    size_t below = diskStatAddSlaves(d, mj, mn);
+    if (below == 0) {
+      // a leaf
+      snprintf(fn, sizeof(fn), "%s/%s/size", s, de->d_name);
+      sysfsRead(fn, v, 100);
+      diskStatAddDevice(d, mj, mn, 512L * atol(v));
+      below = 1;
+    }
+    added += below;
+  }
+  closedir(dir);
+  return added;
+}
+
+/* creates a new string, the kernel name e.g. sda or md0 */
+char *diskStatName(const unsigned int major, const unsigned int minor) {
+  char s[PATH_MAX], v[1000];
+  sprintf(s, "/sys/dev/block/%u:%u/uevent", major, minor);
+  if (sysfsRead(s, v, 1000)) {
+    char *p = strstr(v, "DEVNAME=");
+    if (p) {
+      p += strlen("DEVNAME=");
+      char *e = strchr(p, '\n');
+      if (e) *e = 0;
+      return strdup(p);
+    }
+  }
+  sprintf(v, "%u:%u", major, minor);
+  return strdup(v);
+}
+
 void diskStatAddStart(diskStatType *d, size_t reads, size_t writes) {
-  d->startSecRead += reads;
-  d->startSecWrite += writes;
+  d->start.readSectors += reads;
+  d->start.writeSectors += writes;
 }
 
 void diskStatAddFinish(diskStatType *d, size_t reads, size_t writes) {
-  d->finishSecRead += reads;
-  d->finishSecWrite += writes;
+  d->finish.readSectors += reads;
+  d->finish.writeSectors += writes;
 }
 
 
 void diskStatSummary(diskStatType *d, size_t *totalReadBytes, size_t *totalWriteBytes, size_t *totalReadIO, size_t *totalWriteIO, double *util, size_t shouldReadBytes, size_t shouldWriteBytes, int verbose, double elapsed) {
-  if (d->startSecRead > d->finishSecRead) {
+  if (d->start.readSectors > d->finish.readSectors) {
     fprintf(stderr,"start more than fin!\n");
   } 
-  if (d->startSecWrite > d->finishSecWrite) {
+  if (d->start.writeSectors > d->finish.writeSectors) {
     fprintf(stderr,"start more than fin2!\n");
   } 
-  *totalReadBytes = (d->finishSecRead - d->startSecRead) * 512L;
-  *totalWriteBytes =(d->finishSecWrite - d->startSecWrite) * 512L;
-  *totalReadIO = (d->finishIORead - d->startIORead);
-  *totalWriteIO = (d->finishIOWrite - d->startIOWrite);
+  *totalReadBytes = (d->finish.readSectors - d->start.readSectors) * 512L;
+  *totalWriteBytes =(d->finish.writeSectors - d->start.writeSectors) * 512L;
+  *totalReadIO = (d->finish.readIOs - d->start.readIOs);
+  *totalWriteIO = (d->finish.writeIOs - d->start.writeIOs);
   
-  *util = 100.0 * ((d->finishSecTimeio - d->startSecTimeio)/1000.0 / d->numDevices) / elapsed;
+  *util = 100.0 * ((d->finish.ioTicks - d->start.ioTicks)/1000.0 / d->numDevices) / elapsed;
   
   if (verbose && (shouldReadBytes || shouldWriteBytes)) {
     if (*totalReadBytes)
@@ -102,16 +191,89 @@ void diskStatUsage(diskStatType *d, size_t *sread, size_t *swritten, size_t *sti
   *ioread = 0;
   *iowrite1 = 0;
   for (size_t i = 0; i < d->numDevices; i++) {
-    size_t sr = 0, sw = 0, sio = 0, readscompl = 0, writescompl = 0;
-    getProcDiskstats(d->majorArray[i], d->minorArray[i], &sr, &sw, &sio, &readscompl, &writescompl);
+    diskStatSampleType one;
+    diskStatSampleDevice(d, i, &one);
     if (verbose) {
-      fprintf(stderr,"*info* major %d minor %d sectorsRead %zd sectorsWritten %zd\n", d->majorArray[i], d->minorArray[i], sr, sw);
+      fprintf(stderr,"*info* major %d minor %d sectorsRead %zd sectorsWritten %zd\n", d->majorArray[i], d->minorArray[i], one.readSectors, one.writeSectors);
+    }
+    *sread = (*sread) + one.readSectors;
+    *swritten = (*swritten) + one.writeSectors;
+    *stimeio = (*stimeio) + one.ioTicks;
+    *ioread = (*ioread) + one.readIOs;
+    *iowrite1 = (*iowrite1) + one.writeIOs;
+  }
+}
+
+
+/* parse up to max unsigned decimal numbers separated by white space, in
+ * place and without allocation. Returns the count */
+size_t diskStatParseCounters(const char *s, const char *end, size_t *values, const size_t max) {
+  size_t count = 0;
+  while (s < end && count < max) {
+    while (s < end && (*s == ' ' || *s == '\t')) s++;
+    if (s >= end || *s < '0' || *s > '9') break;
+    size_t v = 0;
+    while (s < end && *s >= '0' && *s <= '9') {
+      v = v * 10 + (*s - '0');
+      s++;
+    }
+    values[count++] = v;
+  }
+  return count;
+}
+
+// the fields in kernel order, the discard/flush counters are 0 on older kernels
+void diskStatSampleFromCounters(diskStatSampleType *s, const size_t *v, const size_t count) {
+  size_t *dest[DISKSTATFIELDS] = {&s->readIOs, &s->readMerges, &s->readSectors, &s->readTicks,
+				  &s->writeIOs, &s->writeMerges, &s->writeSectors, &s->writeTicks,
+				  &s->inFlight, &s->ioTicks, &s->queueTicks,
+				  &s->discardIOs, &s->discardMerges, &s->discardSectors, &s->discardTicks,
+				  &s->flushIOs, &s->flushTicks};
+  memset(s, 0, sizeof(diskStatSampleType));
+  for (size_t i = 0; i < count && i < DISKSTATFIELDS; i++) {
+    *dest[i] = v[i];
+  }
+}
+
+// one device, from the open sysfs stat file or /proc/diskstats. Returns 1 if found
+int diskStatSampleDevice(diskStatType *d, const size_t index, diskStatSampleType *s) {
+  if (d->fdArray[index] >= 0) {
+    char buf[512];
+    const ssize_t got = pread(d->fdArray[index], buf, sizeof(buf), 0);
+    if (got > 0) {
+      size_t v[DISKSTATFIELDS];
+      const size_t count = diskStatParseCounters(buf, buf + got, v, DISKSTATFIELDS);
+      diskStatSampleFromCounters(s, v, count);
+      return count >= 11;
+    }
+  }
+  return getProcDiskstatsSample(d->majorArray[index], d->minorArray[index], s);
+}
+
+// the sum of the counters over all the devices
+void diskStatSample(diskStatType *d, diskStatSampleType *s) {
+  memset(s, 0, sizeof(diskStatSampleType));
+  for (size_t i = 0; i < d->numDevices; i++) {
+    diskStatSampleType one;
+    if (diskStatSampleDevice(d, i, &one)) {
+      s->readIOs += one.readIOs;
+      s->readMerges += one.readMerges;
+      s->readSectors += one.readSectors;
+      s->readTicks += one.readTicks;
+      s->writeIOs += one.writeIOs;
+      s->writeMerges += one.writeMerges;
+      s->writeSectors += one.writeSectors;
+      s->writeTicks += one.writeTicks;
+      s->inFlight += one.inFlight;
+      s->ioTicks += one.ioTicks;
+      s->queueTicks += one.queueTicks;
+      s->discardIOs += one.discardIOs;
+      s->discardMerges += one.discardMerges;
+      s->discardSectors += one.discardSectors;
+      s->discardTicks += one.discardTicks;
+      s->flushIOs += one.flushIOs;
+      s->flushTicks += one.flushTicks;
     }
-    *sread = (*sread) + sr;
-    *swritten = (*swritten) + sw;
-    *stimeio = (*stimeio) + sio;
-    *ioread = (*ioread) + readscompl;
-    *iowrite1 = (*iowrite1) + writescompl;
   }
 }
 
@@ -152,29 +314,71 @@ void diskStatFromFilelist(diskStatType *d, const char *path, int verbose) {
 
 void diskStatStart(diskStatType *d) {
   diskStatClear(d);
-  size_t sread = 0, swritten = 0, stimeio = 0, ioread = 0, iowrite = 0;
-  diskStatUsage(d, &sread, &swritten, &stimeio, &ioread, &iowrite, 0);
-  d->startSecRead = sread;
-  d->startSecWrite = swritten;
-  d->startSecTimeio = stimeio;
-  d->startIORead = ioread;
-  d->startIOWrite = iowrite;
+  diskStatSample(d, &d->start);
 }
 
 void diskStatFinish(diskStatType *d) {
-  size_t sread = 0, swritten = 0, stimeio = 0, ioread = 0, iowrite = 0;
-  diskStatUsage(d, &sread, &swritten, &stimeio, &ioread, &iowrite, 0);
-  d->finishSecRead = sread;
-  d->finishSecWrite = swritten;
-  d->finishSecTimeio = stimeio;
-  d->finishIORead = ioread;
-  d->finishIOWrite = iowrite;
+  diskStatSample(d, &d->finish);
+}
+
+
+/* one line of device level throughput between start and finish, and the
+ * amplification compared to what the application submitted */
+void diskStatPrintLine(FILE *fp, const char *label, const diskStatType *d, const double elapsed, const size_t appReadBytes, const size_t appWriteBytes) {
+  if (elapsed <= 0 || d->numDevices == 0) {
+    return;
+  }
+  const diskStatSampleType *s = &d->start, *f = &d->finish;
+  const size_t rb = (f->readSectors - s->readSectors) * 512L, wb = (f->writeSectors - s->writeSectors) * 512L;
+  const size_t ri = f->readIOs - s->readIOs, wi = f->writeIOs - s->writeIOs;
+  const double util = 100.0 * ((f->ioTicks - s->ioTicks) / 1000.0 / d->numDevices) / elapsed;
+
+  fprintf(fp, "        %s: read ", label);
+  commaPrint0dp(fp, TOMiB(rb) / elapsed);
+  fprintf(fp, " MiB/s (");
+  commaPrint0dp(fp, ri / elapsed);
+  fprintf(fp, " IOPS / %zd, merges %zd), write ", ri ? rb / ri : 0, f->readMerges - s->readMerges);
+  commaPrint0dp(fp, TOMiB(wb) / elapsed);
+  fprintf(fp, " MiB/s (");
+  commaPrint0dp(fp, wi / elapsed);
+  fprintf(fp, " IOPS / %zd, merges %zd), util %.0lf %%, inflight %zd", wi ? wb / wi : 0, f->writeMerges - s->writeMerges, util, f->inFlight);
+  if (f->flushIOs - s->flushIOs) {
+    fprintf(fp, ", flushes %zd", f->flushIOs - s->flushIOs);
+  }
+  if (f->discardIOs - s->discardIOs) {
+    fprintf(fp, ", discard %.0lf MiB/s", TOMiB((f->discardSectors - s->discardSectors) * 512L) / elapsed);
+  }
+  if (appReadBytes) {
+    fprintf(fp, ", ampR %.2lf", rb * 1.0 / appReadBytes);
+  }
+  if (appWriteBytes) {
+    fprintf(fp, ", ampW %.2lf", wb * 1.0 / appWriteBytes);
+  }
+  fprintf(fp, "\n");
+}
+
+// the same values as diskStatPrintLine as a JSON object
+void diskStatJSON(FILE *fp, const diskStatType *d, const double elapsed) {
+  const diskStatSampleType *s = &d->start, *f = &d->finish;
+  const double e = (elapsed > 0) ? elapsed : 1;
+  const size_t rb = (f->readSectors - s->readSectors) * 512L, wb = (f->writeSectors - s->writeSectors) * 512L;
+  const size_t ri = f->readIOs - s->readIOs, wi = f->writeIOs - s->writeIOs;
+  const double util = d->numDevices ? 100.0 * ((f->ioTicks - s->ioTicks) / 1000.0 / d->numDevices) / e : 0;
+  fprintf(fp, "{\"devices\": %zd, \"readMiBs\": %.2lf, \"readIOPS\": %.0lf, \"readMerges\": %zd, \"writeMiBs\": %.2lf, \"writeIOPS\": %.0lf, \"writeMerges\": %zd, \"util\": %.1lf, \"inFlight\": %zd, \"flushes\": %zd, \"discardMiBs\": %.2lf}",
+	  d->numDevices, TOMiB(rb) / e, ri / e, f->readMerges - s->readMerges, TOMiB(wb) / e, wi / e, f->writeMerges - s->writeMerges,
+	  util, f->inFlight, f->flushIOs - s->flushIOs, TOMiB((f->discardSectors - s->discardSectors) * 512L) / e);
 }
 
 void diskStatFree(diskStatType *d) {
   if (d->majorArray) {free(d->majorArray); d->majorArray = NULL;}
   if (d->minorArray) {free(d->minorArray); d->minorArray = NULL;}
   if (d->sizeArray) {free(d->sizeArray); d->sizeArray = NULL;}
+  if (d->fdArray) {
+    for (size_t i = 0; i < d->numDevices; i++) {
+      if (d->fdArray[i] >= 0) close(d->fdArray[i]);
+    }
+    free(d->fdArray); d->fdArray = NULL;
+  }
   diskStatClear(d);
   d->numDevices = 0;
   d->allocDevices = 0;
@@ -193,33 +397,43 @@ void majorAndMinor(int fd, unsigned int *major, unsigned int *minor) {
 }
   
 void getProcDiskstats(const unsigned int major, const unsigned int minor, size_t *sread, size_t *swritten, size_t *stimeIO, size_t *readcompl, size_t *writecompl) {
+  diskStatSampleType s;
+  if (getProcDiskstatsSample(major, minor, &s)) {
+    *sread = s.readSectors;
+    *swritten = s.writeSectors;
+    *stimeIO = s.ioTicks;
+    *readcompl = s.readIOs;
+    *writecompl = s.writeIOs;
+  }
+}
+
+// all the counters for one device from /proc/diskstats, returns 1 if found
+int getProcDiskstatsSample(const unsigned int major, const unsigned int minor, diskStatSampleType *ds) {
+  memset(ds, 0, sizeof(diskStatSampleType));
   FILE *fp = fopen("/proc/diskstats", "rt");
   if (!fp) {
     fprintf(stderr,"can't open diskstats!\n");
-    return;
+    return 0;
   }
-  char *line = NULL;
-  size_t len = 0;
-  ssize_t read = 0;
-  char *str;
-  CALLOC(str, 1000, 1);
-  while ((read = getline(&line, &len, fp)) != -1) {
-    long mj, mn, s;
-    size_t read1, write1, timespentIO, readcompl1, writecompl1;
-    sscanf(line,"%ld %ld %s %lu %ld %zu %ld %lu %ld %zu %ld %ld %zu", &mj, &mn, str, &readcompl1, &s, &read1, &s, &writecompl1, &s, &write1, &s, &s, &timespentIO);
-    if (mj == major && mn == minor) {
-      *sread = read1;
-      *swritten = write1;
-      *stimeIO = timespentIO;
-      *readcompl = readcompl1;
-      *writecompl = writecompl1;
+  int found = 0;
+  char line[1024];
+  while (fgets(line, sizeof(line), fp)) {
+    // major minor name counters...
+    const char *end = line + strlen(line);
+    size_t mm[2];
+    if (diskStatParseCounters(line, end, mm, 2) == 2 && mm[0] == major && mm[1] == minor) {
+      const char *p = line;
+      for (int field = 0; field < 3; field++) { // skip over major, minor and the name
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	while (p < end && *p != ' ' && *p != '\t') p++;
+      }
+      size_t v[DISKSTATFIELDS];
+      const size_t count = diskStatParseCounters(p, end, v, DISKSTATFIELDS);
+      diskStatSampleFromCounters(ds, v, count);
+      found = (count >= 11);
       break;
-      //      printf("Retrieved line of length (%u %u) (%zd %zd) :\n", mj, mn, *sread, *swritten);
-      //      printf("%s", line);
     }
   }
-  free(str);
-  free(line);
   fclose(fp);
+  return found;
 }
-
@@ -1,27 +1,42 @@
 #ifndef _DISKSTATS_H
 #define _DISKSTATS_H
 
+#include <stdio.h>
 #include <unistd.h>
 
+// the counters of /sys/block/X/stat (or /proc/diskstats), or a sum over devices
+#define DISKSTATFIELDS 17
+
 typedef struct {
-  size_t startSecRead;
-  size_t startSecWrite;
-  size_t startSecTimeio;
-  size_t startIORead;
-  size_t startIOWrite;
-  
-  size_t finishSecRead;
-  size_t finishSecWrite;
-  size_t finishSecTimeio;
-  size_t finishIORead;
-  size_t finishIOWrite;
+  size_t readIOs;
+  size_t readMerges;
+  size_t readSectors;
+  size_t readTicks;
+  size_t writeIOs;
+  size_t writeMerges;
+  size_t writeSectors;
+  size_t writeTicks;
+  size_t inFlight;
+  size_t ioTicks;
+  size_t queueTicks;
+  size_t discardIOs;   // 4.18+
+  size_t discardMerges;
+  size_t discardSectors;
+  size_t discardTicks;
+  size_t flushIOs;     // 5.5+
+  size_t flushTicks;
+} diskStatSampleType;
 
+typedef struct {
+  diskStatSampleType start;
+  diskStatSampleType finish;
 
   size_t numDevices;
   size_t allocDevices;
   int *majorArray;
   int *minorArray;
   size_t *sizeArray;
+  int *fdArray;        // open /sys/dev/block/M:m/stat, -1 to use /proc/diskstats
 } diskStatType;
 
 void diskStatSetup(diskStatType *d);
@@ -29,14 +44,25 @@ void diskStatAddStart(diskStatType *d, size_t readSectors, size_t writeSectors);
 void diskStatAddFinish(diskStatType *d, size_t readSectors, size_t writeSectors);
 void diskStatSummary(diskStatType *d, size_t *totalReadBytes, size_t *totalWriteBytes, size_t *totalReadIO, size_t *totalWriteIO, double *util, size_t shouldReadBytes, size_t shouldWriteBytes, int verbose, double elapsed);
 void diskStatAddDrive(diskStatType *d, int fd);
+void diskStatAddDevice(diskStatType *d, const unsigned int major, const unsigned int minor, const size_t size);
+int  diskStatAddPath(diskStatType *d, const char *path, unsigned int *major, unsigned int *minor);
+size_t diskStatAddSlaves(diskStatType *d, const unsigned int major, const unsigned int minor);
+char *diskStatName(const unsigned int major, const unsigned int minor);
 void diskStatSectorUsage(diskStatType *d, size_t *sread, size_t *swritten, size_t *stimeio, size_t *ioread, size_t *iowrite, int verbose);
+void diskStatSample(diskStatType *d, diskStatSampleType *s);
+int  diskStatSampleDevice(diskStatType *d, const size_t index, diskStatSampleType *s);
+size_t diskStatParseCounters(const char *s, const char *end, size_t *values, const size_t max);
+void diskStatSampleFromCounters(diskStatSampleType *s, const size_t *values, const size_t count);
 void diskStatFromFilelist(diskStatType *d, const char *path, int verbose);
 void diskStatStart(diskStatType *d);
 void diskStatFinish(diskStatType *d);
 void diskStatFree(diskStatType *d);
 size_t diskStatTotalDeviceSize(diskStatType *d);
+void diskStatPrintLine(FILE *fp, const char *label, const diskStatType *d, const double elapsed, const size_t appReadBytes, const size_t appWriteBytes);
+void diskStatJSON(FILE *fp, const diskStatType *d, const double elapsed);
 
 void getProcDiskstats(const unsigned int major, const unsigned int minor, size_t *sread, size_t *swritten, size_t *stimeIO, size_t *readscompl, size_t *writecompl);
+int  getProcDiskstatsSample(const unsigned int major, const unsigned int minor, diskStatSampleType *s);
 
 #endif
 
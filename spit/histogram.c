@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "histogram.h"
+
+
+void histogramInit(histogramType *h) {
+  memset(h, 0, sizeof(histogramType));
+}
+
+// the bucket for a latency in microseconds
+size_t histogramBucket(size_t us) {
+  if (us < HISTOGRAMSUB) {
+    return us;
+  }
+  if (us >> HISTOGRAMMAXBITS) {
+    us = ((size_t)1 << HISTOGRAMMAXBITS) - 1; // clamp, ~12 days
+  }
+  const size_t msb = 63 - __builtin_clzl(us);
+  const size_t sub = (us >> (msb - HISTOGRAMSUBBITS)) & (HISTOGRAMSUB - 1);
+  return (msb - HISTOGRAMSUBBITS + 1) * HISTOGRAMSUB + sub;
+}
+
+size_t histogramBucketLow(const size_t index) {
+  if (index < HISTOGRAMSUB) {
+    return index;
+  }
+  const size_t msb = index / HISTOGRAMSUB + HISTOGRAMSUBBITS - 1;
+  const size_t sub = index % HISTOGRAMSUB;
+  return (HISTOGRAMSUB + sub) << (msb - HISTOGRAMSUBBITS);
+}
+
+size_t histogramBucketHigh(const size_t index) {
+  if (index < HISTOGRAMSUB) {
+    return index + 1;
+  }
+  const size_t msb = index / HISTOGRAMSUB + HISTOGRAMSUBBITS - 1;
+  return histogramBucketLow(index) + ((size_t)1 << (msb - HISTOGRAMSUBBITS));
+}
+
+
+void histogramAdd(histogramType *h, const double seconds) {
+  const size_t us = (seconds > 0) ? (size_t)(seconds * 1000000.0) : 0;
+  h->bucket[histogramBucket(us)]++;
+  h->sumus += us;
+  if (us > h->maxus) h->maxus = us;
+  h->count++;
+}
+
+void histogramMerge(histogramType *dest, const histogramType *src) {
+  for (size_t i = 0; i < HISTOGRAMBUCKETS; i++) {
+    dest->bucket[i] += src->bucket[i];
+  }
+  dest->count += src->count;
+  dest->sumus += src->sumus;
+  if (src->maxus > dest->maxus) dest->maxus = src->maxus;
+}
+
+// dest = now - prev, for the values in an interval. The max is the max seen so far
+void histogramDelta(histogramType *dest, const histogramType *now, const histogramType *prev) {
+  for (size_t i = 0; i < HISTOGRAMBUCKETS; i++) {
+    dest->bucket[i] = now->bucket[i] - prev->bucket[i];
+  }
+  dest->count = now->count - prev->count;
+  dest->sumus = now->sumus - prev->sumus;
+  dest->maxus = now->maxus;
+}
+
+
+double histogramMean(const histogramType *h) {
+  if (h->count == 0) {
+    return 0;
+  }
+  return h->sumus / 1000000.0 / h->count;
+}
+
+double histogramMax(const histogramType *h) {
+  return h->maxus / 1000000.0;
+}
+
+// the midpoint of the bucket that holds the pct'th percentile
+double histogramPercentile(const histogramType *h, const double pct) {
+  size_t total = 0;
+  for (size_t i = 0; i < HISTOGRAMBUCKETS; i++) {
+    total += h->bucket[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  size_t want = (size_t)(total * pct / 100.0 + 0.5);
+  if (want < 1) want = 1;
+  if (want > total) want = total;
+
+  size_t sum = 0;
+  for (size_t i = 0; i < HISTOGRAMBUCKETS; i++) {
+    sum += h->bucket[i];
+    if (sum >= want) {
+      return (histogramBucketLow(i) + histogramBucketHigh(i)) / 2.0 / 1000000.0;
+    }
+  }
+  return histogramMax(h);
+}
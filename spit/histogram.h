@@ -0,0 +1,37 @@
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include <stdio.h>
+
+/*
+ * fixed size log/linear latency histogram in microseconds. Values below 16us
+ * have their own bucket, above that each power of two is split into 16
+ * sub-buckets (~3% error). No allocation, so it can be updated on the I/O
+ * path and copied by another thread for an interval delta.
+ */
+#define HISTOGRAMSUBBITS 4
+#define HISTOGRAMSUB (1 << HISTOGRAMSUBBITS)
+#define HISTOGRAMMAXBITS 40
+#define HISTOGRAMBUCKETS ((HISTOGRAMMAXBITS - HISTOGRAMSUBBITS + 1) * HISTOGRAMSUB)
+
+typedef struct {
+  size_t count;
+  size_t sumus;
+  size_t maxus;
+  size_t bucket[HISTOGRAMBUCKETS];
+} histogramType;
+
+void histogramInit(histogramType *h);
+void histogramAdd(histogramType *h, const double seconds);
+void histogramMerge(histogramType *dest, const histogramType *src);
+void histogramDelta(histogramType *dest, const histogramType *now, const histogramType *prev);
+
+size_t histogramBucket(const size_t us);
+size_t histogramBucketLow(const size_t index);
+size_t histogramBucketHigh(const size_t index);
+
+double histogramMean(const histogramType *h); // seconds
+double histogramPercentile(const histogramType *h, const double pct); // [0..100], seconds
+double histogramMax(const histogramType *h); // seconds
+
+#endif
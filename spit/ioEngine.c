@@ -0,0 +1,216 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "ioEngine.h"
+#include "utils.h"
+
+/**
+ * ioEngine.c
+ *
+ * the submit/complete interface used by aioMultiplePositions. The AIO
+ * engine passes through to libaio, the null engine completes each I/O
+ * as it is submitted so the cost of spit itself can be measured, and
+ * the sim engine completes I/Os when a simulated device says they're done
+ *
+ */
+
+const char *ioEngineName(const int kind) {
+  switch (kind) {
+  case IOENGINEAIO: return "aio";
+  case IOENGINENULL: return "null";
+  case IOENGINESIM: return "sim";
+  default: return "unknown";
+  }
+}
+
+
+// the engine for a job's device, null overrides
+int ioEngineKind(const char *device, const int null) {
+  if (null) return IOENGINENULL;
+  if (simDevicePath(device)) return IOENGINESIM;
+  return IOENGINEAIO;
+}
+
+
+// if the job needs to open the device
+int ioEngineUsesDevice(const int kind) {
+  return (kind == IOENGINEAIO);
+}
+
+
+int ioEngineSetup(ioEngineType *e, const int kind, const size_t QD, const char *device, const size_t size) {
+  memset(e, 0, sizeof(ioEngineType));
+  e->kind = kind;
+
+  if (kind == IOENGINEAIO) {
+    return io_setup(QD, &e->ioc);
+  }
+
+  e->doneSize = QD;
+  CALLOC(e->done, QD, sizeof(struct io_event));
+  if (kind == IOENGINESIM) {
+    e->sim = simDeviceOpen(device, size);
+    CALLOC(e->pendingFinish, QD, sizeof(double));
+    CALLOC(e->pendingCb, QD, sizeof(struct iocb*));
+  }
+  return 0;
+}
+
+
+static void pendingSwap(ioEngineType *e, const size_t a, const size_t b) {
+  const double f = e->pendingFinish[a];
+  struct iocb *cb = e->pendingCb[a];
+  e->pendingFinish[a] = e->pendingFinish[b];
+  e->pendingCb[a] = e->pendingCb[b];
+  e->pendingFinish[b] = f;
+  e->pendingCb[b] = cb;
+}
+
+static void pendingPush(ioEngineType *e, struct iocb *cb, const double finish) {
+  size_t i = e->pendingCount++;
+  e->pendingFinish[i] = finish;
+  e->pendingCb[i] = cb;
+  while (i > 0 && e->pendingFinish[(i - 1) / 2] > e->pendingFinish[i]) {
+    pendingSwap(e, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static struct iocb *pendingPop(ioEngineType *e) {
+  struct iocb *cb = e->pendingCb[0];
+  e->pendingCount--;
+  e->pendingFinish[0] = e->pendingFinish[e->pendingCount];
+  e->pendingCb[0] = e->pendingCb[e->pendingCount];
+
+  size_t i = 0;
+  for (;;) {
+    size_t smallest = i;
+    const size_t l = 2 * i + 1, r = 2 * i + 2;
+    if (l < e->pendingCount && e->pendingFinish[l] < e->pendingFinish[smallest]) smallest = l;
+    if (r < e->pendingCount && e->pendingFinish[r] < e->pendingFinish[smallest]) smallest = r;
+    if (smallest == i) break;
+    pendingSwap(e, i, smallest);
+    i = smallest;
+  }
+  return cb;
+}
+
+
+// sleep most of the way, then spin so simulated latencies are accurate to a few us
+static void waitUntil(const double t) {
+  double now = timedouble();
+  if (t - now > 200e-6) {
+    const double s = t - now - 100e-6;
+    struct timespec ts;
+    ts.tv_sec = (time_t) s;
+    ts.tv_nsec = (long) ((s - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+  }
+  while (timedouble() < t) {
+  }
+}
+
+
+// add to the completed ring, there can't be more than QD in flight
+static void ioEngineComplete(ioEngineType *e, struct iocb *cb, const long res) {
+  assert(e->doneCount < e->doneSize);
+  struct io_event *ev = &e->done[(e->doneHead + e->doneCount) % e->doneSize];
+  ev->data = cb->data;
+  ev->obj = cb;
+  ev->res = res;
+  ev->res2 = 0;
+  e->doneCount++;
+}
+
+
+// returns the number submitted (1), or < 0 on error like io_submit
+int ioEngineSubmit(ioEngineType *e, struct iocb *cb) {
+  if (e->kind == IOENGINEAIO) {
+    if (e->stripe) {
+      stripeMap(e->stripe, cb);
+    }
+    return io_submit(e->ioc, 1, &cb);
+  }
+
+  if (e->kind == IOENGINESIM) {
+    const double finish = simDeviceSubmit(e->sim, cb->aio_lio_opcode == IO_CMD_PWRITE, cb->u.c.buf, cb->u.c.nbytes, cb->u.c.offset, timedouble());
+    pendingPush(e, cb, finish);
+    return 1;
+  }
+
+  ioEngineComplete(e, cb, cb->u.c.nbytes);
+  return 1;
+}
+
+
+// move the simulated I/Os that have finished by now to the completed ring
+static void ioEngineSimReap(ioEngineType *e, const double now) {
+  while (e->pendingCount && e->pendingFinish[0] <= now) {
+    struct iocb *cb = pendingPop(e);
+    ioEngineComplete(e, cb, cb->u.c.nbytes);
+  }
+}
+
+
+int ioEngineGetEvents(ioEngineType *e, const long min, const long max, struct io_event *events, struct timespec *timeout) {
+  if (e->kind == IOENGINEAIO) {
+    return io_getevents(e->ioc, min, max, events, timeout);
+  }
+
+  if (e->kind == IOENGINESIM) {
+    double deadline = 9e99;
+    if (timeout) {
+      deadline = timedouble() + timeout->tv_sec + timeout->tv_nsec / 1e9;
+    }
+    ioEngineSimReap(e, timedouble());
+    while ((long)e->doneCount < min && e->pendingCount) {
+      const double next = MIN(e->pendingFinish[0], deadline);
+      waitUntil(next);
+      ioEngineSimReap(e, timedouble());
+      if (next >= deadline) break;
+    }
+  }
+
+  long n = 0;
+  while (n < max && e->doneCount) {
+    events[n++] = e->done[e->doneHead];
+    e->doneHead = (e->doneHead + 1) % e->doneSize;
+    e->doneCount--;
+  }
+  return n;
+}
+
+
+int ioEngineFlush(ioEngineType *e, const int fd) {
+  if (e->kind == IOENGINEAIO) {
+    return e->stripe ? stripeFlush(e->stripe) : fsync(fd);
+  } else if (e->kind == IOENGINESIM) {
+    waitUntil(simDeviceFlush(e->sim, timedouble()));
+  }
+  return 0;
+}
+
+
+// if reads return what was written, so the read watermarks can be checked
+int ioEngineReturnsData(const ioEngineType *e) {
+  return (e->kind == IOENGINEAIO) || (e->kind == IOENGINESIM && e->sim->retain);
+}
+
+
+void ioEngineDestroy(ioEngineType *e) {
+  if (e->kind == IOENGINEAIO) {
+    io_destroy(e->ioc);
+  }
+  if (e->sim) {
+    simDeviceClose(e->sim);
+    free(e->pendingFinish);
+    free(e->pendingCb);
+  }
+  free(e->done);
+  e->done = NULL;
+}
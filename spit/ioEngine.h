@@ -0,0 +1,39 @@
+#ifndef _IOENGINE_H
+#define _IOENGINE_H
+
+#include <libaio.h>
+#include <time.h>
+
+#include "simDevice.h"
+#include "stripe.h"
+
+// where a job's I/Os go. The iocb/io_event of libaio are used by all engines
+#define IOENGINEAIO 0
+#define IOENGINENULL 1  // completes every I/O at submission, no device access
+#define IOENGINESIM 2   // completes on a simDevice's schedule
+
+typedef struct {
+  int kind;
+  io_context_t ioc;        // IOENGINEAIO
+  struct io_event *done;   // completed and not yet reaped, a ring of QD
+  size_t doneSize;
+  size_t doneHead;
+  size_t doneCount;
+  simDeviceType *sim;      // IOENGINESIM
+  double *pendingFinish;   // a min heap of when the submitted I/Os complete
+  struct iocb **pendingCb;
+  size_t pendingCount;
+  stripeType *stripe;      // IOENGINEAIO over several devices, NULL if not
+} ioEngineType;
+
+const char *ioEngineName(const int kind);
+int  ioEngineKind(const char *device, const int null);
+int  ioEngineUsesDevice(const int kind);
+int  ioEngineSetup(ioEngineType *e, const int kind, const size_t QD, const char *device, const size_t size);
+int  ioEngineSubmit(ioEngineType *e, struct iocb *cb);
+int  ioEngineGetEvents(ioEngineType *e, const long min, const long max, struct io_event *events, struct timespec *timeout);
+int  ioEngineFlush(ioEngineType *e, const int fd);
+int  ioEngineReturnsData(const ioEngineType *e);
+void ioEngineDestroy(ioEngineType *e);
+
+#endif
@@ -19,10 +19,42 @@
 
 #include "aioRequests.h"
 #include "diskStats.h"
+#include "timeSeries.h"
+#include "liveStats.h"
+#include "positionLog.h"
+#include "results.h"
+#include "ioEngine.h"
 
 extern volatile int keepRunning;
 extern int verbose;
 
+static volatile int timerRunning = 0; // the workers have finished when 0
+static size_t ioLogRuns = 0;          // a sweep's later runs have their own --iolog files
+
+void jobOptionsInit(jobOptionsType *o) {
+  o->sampleInterval = 1;
+  o->timeSeriesPrefix = NULL;
+  o->resultsFilename = NULL;
+  o->commandLine = NULL;
+  o->perfCounters = 0;
+  o->sweep = NULL;
+  o->sweepWarmup = 0;
+  o->steadyWindow = 0;
+  o->steadyExcursion = 0.2;
+  o->steadySlope = 0.1;
+  preconditionInit(&o->precondition);
+  o->createFill = 1;
+  o->devices = NULL;
+  o->numDevices = 0;
+  o->stripeChunk = 0;
+  o->live = 0;
+  o->stream = NULL;
+  o->control = NULL;
+  o->metrics = NULL;
+  o->positionsText = 0;
+  o->ioLogPrefix = NULL;
+}
+
 void jobInit(jobType *job) {
   job->count = 0;
   job->strings = NULL;
@@ -77,27 +109,70 @@ void jobFree(jobType *job) {
   jobInit(job);
 }
 
-typedef struct {
-  size_t id;
-  positionContainer pos;
-  size_t bdSize;
-  double finishtime;
-  size_t waitfor;
-  char *jobstring;
-  char *jobdevice;
-  size_t blockSize;
-  size_t highBlockSize;
-  size_t queueDepth;
-  size_t flushEvery;
-  float rw;
-  size_t random;
-  unsigned short seed;
-  char *randomBuffer;
-  size_t numThreads;
-  positionContainer **allPC;
-  size_t anywrites;
-  size_t UUID;
-} threadInfoType;
+
+
+// u5 is the first 5 seconds, u5000i the first 5000 I/Os. d is the same for the end
+static void jobParseRamp(const char *jobstring, const char c, double *seconds, size_t *count) {
+  const char *ch = strchr(jobstring, c);
+  if (ch && *(ch+1)) {
+    char *endp = NULL;
+    const double v = strtod(ch+1, &endp);
+    if (v > 0) {
+      if (*endp == 'i') {
+	*count = (size_t)v;
+      } else {
+	*seconds = v;
+      }
+    }
+  }
+}
+
+
+// open once when set up, so the precondition, warm-up and each run share it
+static int jobOpenDevice(threadInfoType *threadContext, const int forWriting) {
+  int fd = -1;
+  const jobOptionsType *options = threadContext->options;
+  const int flags = (forWriting ? O_RDWR : O_RDONLY) | threadContext->direct;
+  if (!ioEngineUsesDevice(threadContext->engine)) {
+    if (verbose >= 2) fprintf(stderr,"*info* %s engine, not opening the device\n", ioEngineName(threadContext->engine));
+    return -1;
+  }
+  if (verbose >= 2) fprintf(stderr,"*info* open with %s\n", forWriting ? "O_RDWR" : "O_RDONLY");
+
+  if (options->stripeChunk) {
+    if (stripeOpen(&threadContext->stripe, options->devices, options->numDevices, options->stripeChunk, flags) == 0) {
+      fd = threadContext->stripe.fds[0]; // the iocbs are pointed at the member when submitted
+      threadContext->pos.stripe = &threadContext->stripe;
+    }
+  } else {
+    fd = open(threadContext->jobdevice, flags);
+  }
+
+  if (fd < 0) {
+    fprintf(stderr,"problem!!\n");
+    perror(threadContext->jobdevice);
+  }
+  return fd;
+}
+
+
+/* the job's engine, once for all the runs so a sim: device keeps its
+ * state. Reopened only if a sweep cell raises the QD, the new one first
+ * so the simulated device isn't closed in between */
+static void jobEngineSetup(threadInfoType *threadContext) {
+  if (threadContext->ioeQD >= threadContext->queueDepth) return;
+  ioEngineType ioe;
+  if (ioEngineSetup(&ioe, threadContext->engine, threadContext->queueDepth, threadContext->jobdevice, threadContext->bdSize)) {
+    fprintf(stderr,"*error* io_setup failed with %zd\n", threadContext->queueDepth);
+    exit(-2);
+  }
+  ioe.stripe = threadContext->pos.stripe;
+  if (threadContext->ioeQD) {
+    ioEngineDestroy(&threadContext->ioe);
+  }
+  threadContext->ioe = ioe;
+  threadContext->ioeQD = threadContext->queueDepth;
+}
 
 
 static void *runThread(void *arg) {
@@ -112,23 +187,13 @@ static void *runThread(void *arg) {
 
 
   size_t ios = 0, shouldReadBytes = 0, shouldWriteBytes = 0;
-  int fd,  direct = O_DIRECT;
-  if (strchr(threadContext->jobstring, 'D')) {
+  const int fd = threadContext->fd; // opened by jobSetupThreads
+  if (!threadContext->direct) {
     fprintf(stderr,"*info* thread[%zd] turning off O_DIRECT\n", threadContext->id);
-    direct = 0; // don't use O_DIRECT if the user specifes 'D'
   }
 
-  if (threadContext->anywrites || threadContext->random) {
-    fd = open(threadContext->jobdevice, O_RDWR | direct);
-    if (verbose >= 2) fprintf(stderr,"*info* open with O_RDWR\n");
-  } else {
-    fd = open(threadContext->jobdevice, O_RDONLY | direct);
-    if (verbose >= 2) fprintf(stderr,"*info* open with O_RDONLY\n");
-  }
-    
-  if (fd < 0) {
-    fprintf(stderr,"problem!!\n");
-    perror(threadContext->jobdevice); return 0;
+  if (fd < 0 && ioEngineUsesDevice(threadContext->engine)) {
+    return 0;
   }
 
   
@@ -140,18 +205,35 @@ static void *runThread(void *arg) {
   }
 
 
-  fprintf(stderr,"*info* [t%zd] '%s' pos=%zd, |%zd|, qd=%zd, R/w=%.2g, F=%zd, k=[%zd,%zd], seed %u\n", threadContext->id, threadContext->jobstring, threadContext->pos.sz, threadContext->random, threadContext->queueDepth, threadContext->rw, threadContext->flushEvery, threadContext->blockSize, threadContext->highBlockSize, threadContext->seed);
+  fprintf(stderr,"*info* [t%zd] '%s' pos=%zd, |%zd|, qd=%zd, R/w=%.2g, F=%zd, k=[%zd,%zd], seed %u, %s\n", threadContext->id, threadContext->jobstring, threadContext->pos.sz, threadContext->random, threadContext->queueDepth, threadContext->rw, threadContext->flushEvery, threadContext->blockSize, threadContext->highBlockSize, threadContext->seed, ioEngineName(threadContext->engine));
+
+  // the CPU used by this thread for the I/O, the timer reads the clock for the time series
+  double cpuUser = 0, cpuSys = 0;
+  size_t ctxVol = 0, ctxInvol = 0;
+  if (pthread_getcpuclockid(pthread_self(), &threadContext->pos.cpuClock) == 0) {
+    threadContext->pos.cpuClockValid = 1;
+  }
+  threadCPUUsage(&cpuUser, &cpuSys, &ctxVol, &ctxInvol);
+
+  perfCountersInit(&threadContext->perf);
+  if (threadContext->options->perfCounters) {
+    if (perfCountersOpen(&threadContext->perf) == 0) {
+      fprintf(stderr,"*warning* [t%zd] can't open perf counters, check /proc/sys/kernel/perf_event_paranoid\n", threadContext->id);
+    }
+    perfCountersStart(&threadContext->perf);
+  }
 
   double start = timedouble();
+  positionRampStart(&threadContext->pos, start, threadContext->finishtime);
   if (threadContext->random) {
     size_t s = threadContext->id + threadContext->pos.sz;
-    positionContainer pc;
-    positionContainerInit(&pc, threadContext->UUID);
+    // use the thread's own container so the timer sees the counters
+    positionContainer *pc = &threadContext->pos;
     
     positionType *p = createPositions(threadContext->random);
-    pc.positions = p;
-    while (keepRunning && timedouble() < threadContext->finishtime) {
-      size_t anywrites = setupRandomPositions(p, threadContext->random, threadContext->rw, threadContext->blockSize, threadContext->highBlockSize, MIN(4096, threadContext->blockSize), threadContext->bdSize, s++);
+    pc->positions = p;
+    while (keepRunning && !pc->control.stop && timedouble() < threadContext->finishtime) {
+      size_t anywrites = setupRandomPositions(p, threadContext->random, threadContext->rw, threadContext->blockSize, threadContext->highBlockSize, MIN(4096, threadContext->blockSize), threadContext->bdSize, s++, threadContext->options->stripeChunk);
       threadContext->anywrites = anywrites;
       
       if (verbose >= 2) {
@@ -159,22 +241,46 @@ static void *runThread(void *arg) {
 	dumpPositions(p, "random", threadContext->random, 10);
       }
 
-      aioMultiplePositions(&pc, threadContext->random, threadContext->finishtime, threadContext->queueDepth, -1 /*verbose*/, 0, NULL, &benchl, threadContext->randomBuffer, threadContext->highBlockSize, MIN(4096, threadContext->blockSize), &ios, &shouldReadBytes, &shouldWriteBytes, 1 /* one shot*/, 1, fd, threadContext->flushEvery);
+      aioMultiplePositions(pc, threadContext->random, threadContext->finishtime, threadContext->queueDepth, -1 /*verbose*/, 0, NULL, &benchl, threadContext->randomBuffer, threadContext->highBlockSize, MIN(4096, threadContext->blockSize), &ios, &shouldReadBytes, &shouldWriteBytes, 1 /* one shot*/, 1, fd, threadContext->flushEvery, &threadContext->ioe);
     }
 
-
+    pc->positions = NULL; // not kept, the next batch overwrites them
     freePositions(p);
   } else {
-    aioMultiplePositions(&threadContext->pos, threadContext->pos.sz, threadContext->finishtime, threadContext->queueDepth, -1 /* verbose */, 0, NULL, &benchl, threadContext->randomBuffer, threadContext->highBlockSize, MIN(4096,threadContext->blockSize), &ios, &shouldReadBytes, &shouldWriteBytes, 0, 1, fd, threadContext->flushEvery);
+    aioMultiplePositions(&threadContext->pos, threadContext->pos.sz, threadContext->finishtime, threadContext->queueDepth, -1 /* verbose */, 0, NULL, &benchl, threadContext->randomBuffer, threadContext->highBlockSize, MIN(4096,threadContext->blockSize), &ios, &shouldReadBytes, &shouldWriteBytes, 0, 1, fd, threadContext->flushEvery, &threadContext->ioe);
   }
   fprintf(stderr,"*info [thread %zd] finished '%s'\n", threadContext->id, threadContext->jobstring);
-  threadContext->pos.elapsedTime = timedouble() - start;
+  positionRampFinish(&threadContext->pos, start, timedouble()); // sets elapsedTime
+  if (threadContext->options->perfCounters) {
+    perfCountersStop(&threadContext->perf);
+    perfCountersClose(&threadContext->perf);
+  }
 
-  close(fd);
+  {
+    double u = 0, sy = 0;
+    size_t v = 0, iv = 0;
+    threadCPUUsage(&u, &sy, &v, &iv);
+    threadContext->pos.cpuUser = u - cpuUser;
+    threadContext->pos.cpuSys = sy - cpuSys;
+    threadContext->pos.ctxVoluntary = v - ctxVol;
+    threadContext->pos.ctxInvoluntary = iv - ctxInvol;
+    // the warm-up and cool-down share of the CPU, pro rata by I/Os
+    const positionContainer *pc = &threadContext->pos;
+    const size_t measured = pc->readIOs + pc->writtenIOs;
+    const size_t all = measured + pc->warmup.readIOs + pc->warmup.writtenIOs + pc->cooldown.readIOs + pc->cooldown.writtenIOs;
+    if (all > measured) {
+      threadContext->pos.cpuUser *= (double)measured / all;
+      threadContext->pos.cpuSys *= (double)measured / all;
+    }
+  }
 
   logSpeedFree(&benchl);
-  close(fd);
 
+  // the clock goes with the thread, the timer may still sample
+  if (threadContext->pos.cpuClockValid) {
+    threadContext->pos.cpuClockLast = threadCPUTime(threadContext->pos.cpuClock);
+    threadContext->pos.cpuClockValid = 0;
+  }
   return NULL;
 }
 
@@ -182,39 +288,169 @@ static void *runThread(void *arg) {
 
 #define TIMEPERLINE 1
 
+/* one --stream line, the same interval as the timer's lines. Formatted
+ * into memory so the stream only ever sees whole lines */
+static void jobStreamLine(statsStreamType *stream, const threadInfoType *threadContext, const liveStatsType *live,
+			  const double elapsed, const double now, const double period,
+			  const deviceTotalType *devNow, const deviceTotalType *devPrev, const size_t devCount, const diskStatType *dev) {
+  char *line = NULL;
+  size_t len = 0;
+  FILE *fp = open_memstream(&line, &len);
+  if (!fp) {
+    return;
+  }
+  liveStatsType *total;
+  CALLOC(total, 1, sizeof(liveStatsType));
+
+  fprintf(fp, "{\"time\": %.3lf, \"interval\": %.3lf, \"unixTime\": %.3lf, \"UUID\": %zd, \"jobs\": [", elapsed, period, now, threadContext->UUID);
+  for (size_t j = 0; j < threadContext->numThreads; j++) {
+    fprintf(fp, "%s{\"id\": %zd, ", j ? ", " : "", j);
+    liveStatsJSON(fp, &live[j]);
+    fprintf(fp, "}");
+    liveStatsSum(total, &live[j]);
+  }
+  fprintf(fp, "], \"aggregate\": {");
+  liveStatsJSON(fp, total);
+  fprintf(fp, "}");
+  free(total);
+
+  if (devNow) {
+    fprintf(fp, ", \"perDevice\": [");
+    for (size_t d = 0; d < devCount; d++) {
+      fprintf(fp, "%s{\"device\": ", d ? ", " : "");
+      resultsJSONString(fp, devNow[d].name);
+      fprintf(fp, ", \"readMiBs\": %.2lf, \"readIOPS\": %.0lf, \"writeMiBs\": %.2lf, \"writeIOPS\": %.0lf}",
+	      TOMiB(devNow[d].readBytes - devPrev[d].readBytes) / period, (devNow[d].readIOs - devPrev[d].readIOs) / period,
+	      TOMiB(devNow[d].writtenBytes - devPrev[d].writtenBytes) / period, (devNow[d].writtenIOs - devPrev[d].writtenIOs) / period);
+    }
+    fprintf(fp, "]");
+  }
+  if (dev) {
+    fprintf(fp, ", \"diskStats\": ");
+    diskStatJSON(fp, dev, period);
+  }
+  fprintf(fp, ", \"dropped\": %zd}\n", stream->dropped);
+  fclose(fp);
+
+  statsStreamWrite(stream, line, len);
+  free(line);
+}
+
+
+// one device's part of the live view, or of the summary if prev is NULL
+static void jobPrintDeviceLine(FILE *fp, const deviceTotalType *now, const deviceTotalType *prev, const double elapsed) {
+  const size_t rb = now->readBytes - (prev ? prev->readBytes : 0);
+  const size_t ri = now->readIOs - (prev ? prev->readIOs : 0);
+  const size_t wb = now->writtenBytes - (prev ? prev->writtenBytes : 0);
+  const size_t wi = now->writtenIOs - (prev ? prev->writtenIOs : 0);
+  const double e = (elapsed > 0) ? elapsed : 1;
+  fprintf(fp, "%s%s (%zd job%s): read ", prev ? "        " : "*info* device ", now->name, now->jobs, (now->jobs == 1) ? "" : "s");
+  commaPrint0dp(fp, TOMiB(rb) / e);
+  fprintf(fp, " MiB/s (");
+  commaPrint0dp(fp, ri / e);
+  fprintf(fp, " IOPS), write ");
+  commaPrint0dp(fp, TOMiB(wb) / e);
+  fprintf(fp, " MiB/s (");
+  commaPrint0dp(fp, wi / e);
+  fprintf(fp, " IOPS)\n");
+}
+
 static void *runThreadTimer(void *arg) {
   const threadInfoType *threadContext = (threadInfoType*)arg;
+  const jobOptionsType *options = threadContext->options;
 
   size_t i = 1;
-  //  diskStatType d;
-  //  diskStatSetup(&d);
-  int fd = open(threadContext->jobdevice, O_RDONLY);
-  if (fd < 0) {
-    perror("diskstats"); return NULL;
+
+  // what the block layer did, for the job device and its bottom level md/dm slaves
+  diskStatType dev, slaves;
+  diskStatSetup(&dev);
+  diskStatSetup(&slaves);
+  char *devname = NULL, slavesname[100];
+  unsigned int major = 0, minor = 0;
+  const int multiDevice = (options->numDevices > 1 || options->stripeChunk);
+  if (multiDevice) {
+    size_t added = 0;
+    for (size_t d = 0; d < options->numDevices; d++) {
+      added += diskStatAddPath(&dev, options->devices[d], &major, &minor) ? 1 : 0;
+    }
+    if (added) {
+      CALLOC(devname, 30, 1);
+      sprintf(devname, "%zd devices", added);
+    }
+  } else if (diskStatAddPath(&dev, threadContext->jobdevice, &major, &minor)) {
+    devname = diskStatName(major, minor);
+    diskStatAddSlaves(&slaves, major, minor);
+    sprintf(slavesname, "slaves (%zd)", slaves.numDevices);
+    if (verbose) {
+      fprintf(stderr,"*info* device stats from %s (%u:%u), %zd slave device(s)\n", devname, major, minor, slaves.numDevices);
+    }
   }
-  //  diskStatAddDrive(&d, fd);
-  close(fd);
-  
-  //  diskStatStart(&d);
+  diskStatStart(&dev);
+  diskStatStart(&slaves);
+  const diskStatSampleType devRunStart = dev.start, slavesRunStart = slaves.start;
+
+  // per job time series, sampled at the (sub-second) interval
+  timeSeriesType *ts = NULL;
+  const double interval = (options->sampleInterval > 0) ? options->sampleInterval : TIMEPERLINE;
+  if (options->timeSeriesPrefix) {
+    CALLOC(ts, threadContext->numThreads, sizeof(timeSeriesType));
+    for (size_t j = 0; j < threadContext->numThreads; j++) {
+      timeSeriesOpen(&ts[j], options->timeSeriesPrefix, j);
+    }
+  }
+  size_t sample = 1;
 
   const double start = timedouble();
-  double thistime = 0;
+  double thistime = start, lastsample = start, lastline = start;
   size_t last_trb = 0, last_twb = 0, last_tri = 0, last_twi = 0;
   size_t trb = 0, twb = 0, tri = 0, twi = 0;
+  size_t lastLatCount = 0, lastLatSum = 0;
+
+  // per device lines if there's more than one
+  deviceTotalType *devNow = NULL, *devLast = NULL;
+  size_t devCount = 0;
+  if (multiDevice) {
+    CALLOC(devNow, threadContext->numThreads + options->numDevices, sizeof(deviceTotalType));
+    CALLOC(devLast, threadContext->numThreads + options->numDevices, sizeof(deviceTotalType));
+    devCount = jobDeviceTotals(threadContext, threadContext->numThreads, devLast);
+  }
+  // --live, a line per job, and the --stream
+  liveStatsType *live = NULL;
+  if (options->live || options->stream) {
+    CALLOC(live, threadContext->numThreads, sizeof(liveStatsType));
+    for (size_t j = 0; j < threadContext->numThreads; j++) {
+      liveStatsInit(&live[j], threadContext->allPC[j]);
+    }
+  }
+  steadyStateType *steady = threadContext->steady;
 
-  while (keepRunning && (thistime = timedouble())) {
-    usleep(100000);
-    //    usleep(500000);
+  while (keepRunning && timerRunning) {
+    // sleep until the next line or sample, at most 0.1 s to keep the watchdog responsive
+    double next = start + i * TIMEPERLINE;
+    if (ts && (start + sample * interval < next)) {
+      next = start + sample * interval;
+    }
+    double towait = next - timedouble();
+    if (towait > 0.1) towait = 0.1;
+    if (towait > 0) {
+      usleep(towait * 1000000);
+    }
+    thistime = timedouble();
+
+    if (ts && (thistime - start >= sample * interval) && (thistime <= threadContext->finishtime)) {
+      for (size_t j = 0; j < threadContext->numThreads; j++) {
+	timeSeriesAdd(&ts[j], threadContext->allPC[j], thistime - start, thistime - lastsample);
+      }
+      lastsample = thistime;
+      sample = (size_t)((thistime - start) / interval) + 1; // skip any missed samples
+    }
 
     if (thistime - start >= (i * TIMEPERLINE) && (thistime <= threadContext->finishtime)) {
       
-      //      diskStatFinish(&d);
       trb = 0;
       twb = 0;
       tri = 0;
       twi = 0;
-      //      double util = 0;
-      //diskStatSummary(&d, &trb, &twb, &tri, &twi, &util, 0, 0, 0, thistime - last);
 
       for (size_t j = 0; j < threadContext->numThreads;j++) {
 	trb += threadContext->allPC[j]->readBytes;
@@ -225,7 +461,24 @@ static void *runThreadTimer(void *arg) {
       
       const double elapsed = thistime - start;
 
-      
+      if (steady && steady->window) {
+	size_t latCount = 0, latSum = 0;
+	for (size_t j = 0; j < threadContext->numThreads; j++) {
+	  latCount += threadContext->allPC[j]->readLatency.count + threadContext->allPC[j]->writeLatency.count;
+	  latSum += threadContext->allPC[j]->readLatency.sumus + threadContext->allPC[j]->writeLatency.sumus;
+	}
+	const double iops = (tri + twi - last_tri - last_twi) / (thistime - lastline);
+	const double latency = (latCount > lastLatCount) ? (latSum - lastLatSum) / 1000000.0 / (latCount - lastLatCount) : 0;
+	lastLatCount = latCount;
+	lastLatSum = latSum;
+	if (steadyStateAdd(steady, elapsed, iops, latency)) {
+	  // the workers stop like a control stop, keepRunning is left for the signals
+	  for (size_t j = 0; j < threadContext->numThreads; j++) {
+	    threadContext->allPC[j]->control.stop = 1;
+	  }
+	}
+      }
+
 
       fprintf(stderr,"[%2.0lf / %zd] read ", elapsed, threadContext->numThreads);
       commaPrint0dp(stderr, TOMiB(trb - last_trb));
@@ -238,6 +491,38 @@ static void *runThreadTimer(void *arg) {
       //      fprintf(stderr," IOPS / %zd), util %.0lf %%\n", (twi - last_twi == 0) ? 0 : (twb - last_twb) / (twi - last_twi), util);
       fprintf(stderr," IOPS / %zd)\n", (twi - last_twi == 0) ? 0 : (twb - last_twb) / (twi - last_twi));
 
+      if (devname) {
+	diskStatFinish(&dev);
+	diskStatPrintLine(stderr, devname, &dev, thistime - lastline, trb - last_trb, twb - last_twb);
+	if (slaves.numDevices) {
+	  diskStatFinish(&slaves);
+	  diskStatPrintLine(stderr, slavesname, &slaves, thistime - lastline, trb - last_trb, twb - last_twb);
+	}
+      }
+      if (devNow) {
+	devCount = jobDeviceTotals(threadContext, threadContext->numThreads, devNow);
+	for (size_t d = 0; d < devCount; d++) {
+	  jobPrintDeviceLine(stderr, &devNow[d], &devLast[d], thistime - lastline);
+	}
+	deviceTotalType *t = devLast;
+	devLast = devNow;
+	devNow = t;
+      }
+      if (live) {
+	for (size_t j = 0; j < threadContext->numThreads; j++) {
+	  liveStatsUpdate(&live[j], threadContext->allPC[j], thistime - lastline);
+	  if (options->live) {
+	    liveStatsPrint(stderr, &live[j], j, threadContext[j].jobstring);
+	  }
+	}
+      }
+      if (options->stream) {
+	jobStreamLine(options->stream, threadContext, live, elapsed, thistime, thistime - lastline, devLast, devNow, devCount, devname ? &dev : NULL);
+      }
+      dev.start = dev.finish;
+      slaves.start = slaves.finish;
+      lastline = thistime;
+
       last_trb = trb;
       last_tri = tri;
       last_twb = twb;
@@ -249,7 +534,6 @@ static void *runThreadTimer(void *arg) {
       //      last = thistime;
       
       i++;
-      //      diskStatStart(&d);
     }
 
     if (thistime > threadContext->finishtime + 10) {
@@ -257,28 +541,50 @@ static void *runThreadTimer(void *arg) {
       exit(-1);
     }
   }
-  //  diskStatFree(&d);
+  // device totals for the whole run
+  if (devname) {
+    trb = 0;
+    twb = 0;
+    for (size_t j = 0; j < threadContext->numThreads;j++) {
+      trb += threadContext->allPC[j]->readBytes;
+      twb += threadContext->allPC[j]->writtenBytes;
+    }
+    fprintf(stderr,"*info* device totals over %.1lf s\n", thistime - start);
+    dev.start = devRunStart;
+    diskStatFinish(&dev);
+    diskStatPrintLine(stderr, devname, &dev, thistime - start, trb, twb);
+    if (slaves.numDevices) {
+      slaves.start = slavesRunStart;
+      diskStatFinish(&slaves);
+      diskStatPrintLine(stderr, slavesname, &slaves, thistime - start, trb, twb);
+    }
+    free(devname);
+  }
+  diskStatFree(&dev);
+  diskStatFree(&slaves);
+  free(devNow);
+  free(devLast);
+  free(live);
   //  fprintf(stderr,"finished thread timer\n");
-  keepRunning = 0;
+  if (ts) {
+    for (size_t j = 0; j < threadContext->numThreads; j++) {
+      timeSeriesClose(&ts[j]);
+    }
+    free(ts);
+  }
   return NULL;
 }
 
 
 
-void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
-		   const size_t timetorun, const size_t dumpPos) {
-  pthread_t *pt;
-  CALLOC(pt, num+1, sizeof(pthread_t));
-
+// parse the job strings and create the positions, ready for jobRunPrepared
+threadInfoType *jobSetupThreads(jobType *job, const int num, const size_t maxSizeInBytes,
+				const size_t timetorun, const size_t dumpPos, const jobOptionsType *options) {
   threadInfoType *threadContext;
   CALLOC(threadContext, num+1, sizeof(threadInfoType));
 
-  keepRunning = 1;
-  
   unsigned short seed = (unsigned short)timedouble();
 
-  size_t newmp = 0;
-
   positionContainer **allThreadsPC;
   CALLOC(allThreadsPC, num, sizeof(positionContainer*));
 
@@ -324,7 +630,11 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
     
 
     //    size_t fs = fileSizeFromName(job->devices[i]);
-    threadContext[i].bdSize = maxSizeInBytes;
+    threadContext[i].bdSize = options->stripeChunk ? stripeSize(maxSizeInBytes, options->numDevices, options->stripeChunk) : maxSizeInBytes;
+    if (options->stripeChunk && highbs > options->stripeChunk) {
+      fprintf(stderr,"*error* the block size %d is larger than the stripe chunk %zd\n", highbs, options->stripeChunk);
+      exit(-1);
+    }
     const size_t avgBS = (bs + highbs) / 2;
     size_t mp = (size_t) (threadContext[i].bdSize / avgBS);
     if (verbose) {
@@ -371,12 +681,19 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
     threadContext[i].id = i;
     threadContext[i].UUID = UUID;
     positionContainerInit(&threadContext[i].pos, threadContext[i].UUID);
+    threadContext[i].pos.jobId = i;
+    threadContext[i].pos.bdSize = threadContext[i].bdSize;
+    jobParseRamp(job->strings[i], 'u', &threadContext[i].pos.warmupTime, &threadContext[i].pos.warmupCount);
+    jobParseRamp(job->strings[i], 'd', &threadContext[i].pos.cooldownTime, &threadContext[i].pos.cooldownCount);
     threadContext[i].jobstring = job->strings[i];
     threadContext[i].jobdevice = job->devices[i];
     threadContext[i].waitfor = 0;
     threadContext[i].blockSize = bs;
     threadContext[i].highBlockSize = highbs;
     threadContext[i].random = 0;
+    threadContext[i].limit = limit;
+    threadContext[i].direct = strchr(job->strings[i], 'D') ? 0 : O_DIRECT; // 'D' turns off O_DIRECT
+    threadContext[i].engine = ioEngineKind(job->devices[i], strchr(job->strings[i], 'N') != NULL); // 'N' null engine, no device I/O
 
     // do this here to allow repeatable random numbers
     int rcount = 0, wcount = 0, rwtotal = 0;
@@ -415,6 +732,7 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
 	seqFiles = atoi(sf+1);
       }
     }
+    threadContext[i].seqFiles = seqFiles;
 
     int iRandom = 0;
     {
@@ -436,8 +754,10 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
 	seqFiles = 0;
 	flushEvery = 1;
 	threadContext[i].flushEvery = flushEvery;
+	threadContext[i].seqFiles = seqFiles;
       }
     }
+    threadContext[i].metaData = metaData;
 
     int qDepth = 1024; // 1024 is the default
     {
@@ -449,6 +769,7 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
     if (qDepth < 1) qDepth = 1;
     threadContext[i].queueDepth = qDepth;
     
+    size_t newmp = 0; // per job, jobs with different block sizes have different maximums
     char *pChar = strchr(job->strings[i], 'P');
     {
       if (pChar && *(pChar+1)) {
@@ -495,7 +816,7 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
       // allocate the position array space
       //positionContainerSetup(&threadContext[i].pos, mp, job->devices[i], job->strings[i]);
       // create the positions and the r/w status
-      size_t anywrites = setupPositions(threadContext[i].pos.positions, &threadContext[i].pos.sz, seqFiles, rw, threadContext[i].blockSize, threadContext[i].highBlockSize, MIN(4096,threadContext[i].blockSize), startingBlock, threadContext[i].bdSize, threadContext[i].seed);
+      size_t anywrites = setupPositions(threadContext[i].pos.positions, &threadContext[i].pos.sz, seqFiles, rw, threadContext[i].blockSize, threadContext[i].highBlockSize, MIN(4096,threadContext[i].blockSize), startingBlock, threadContext[i].bdSize, threadContext[i].seed, options->stripeChunk);
 
       threadContext[i].anywrites = anywrites;
       threadContext[i].pos.sz = newmp;
@@ -511,6 +832,9 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
       if (dumpPos && !iRandom) {
 	dumpPositions(threadContext[i].pos.positions, threadContext[i].pos.string, threadContext[i].pos.sz, dumpPos);
       }
+    } else { // the positions are made in the thread, but label the container for the reports
+      threadContext[i].pos.device = strdup(job->devices[i]);
+      threadContext[i].pos.string = strdup(job->strings[i]);
     }
 
     if (newmp <= threadContext[i].queueDepth) {
@@ -522,6 +846,34 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
     allThreadsPC[i] = &threadContext[i].pos;
     threadContext[i].numThreads = num;
     threadContext[i].allPC = allThreadsPC;
+    threadContext[i].options = options;
+    threadContext[i].fd = jobOpenDevice(&threadContext[i], threadContext[i].anywrites || threadContext[i].random || preconditionEnabled(&options->precondition));
+    jobEngineSetup(&threadContext[i]);
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    CALLOC(threadContext[i].randomBuffer, threadContext[i].highBlockSize, 1);
+    memset(threadContext[i].randomBuffer, 0, threadContext[i].highBlockSize);
+    generateRandomBufferCyclic(threadContext[i].randomBuffer, threadContext[i].highBlockSize, threadContext[i].seed, threadContext[i].highBlockSize); 
+  }
+
+  return threadContext;
+}
+
+
+// run the set up jobs for timetorun seconds, the stats of any previous run are cleared
+void jobRunPrepared(threadInfoType *threadContext, const int num, const size_t timetorun, resultsTimingType *timing) {
+  pthread_t *pt;
+  CALLOC(pt, num+1, sizeof(pthread_t));
+
+  const jobOptionsType *options = threadContext[0].options;
+  steadyStateInit(&timing->steady, options->steadyWindow, options->steadyExcursion, options->steadySlope);
+  for (size_t i = 0; i < num; i++) {
+    positionContainerResetStats(&threadContext[i].pos);
+    jobEngineSetup(&threadContext[i]); // a sweep cell may have raised the QD
+    stripeResetStats(&threadContext[i].stripe);
+    threadContext[i].steady = &timing->steady;
+    threadContext[i].pos.control.stop = 0; // a stop is for one run, the rest carries on
   }
 
   // set the starting time
@@ -530,55 +882,206 @@ void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
   assert (finishtime >= currenttime + timetorun);
   for (size_t i = 0; i < num; i++) {
     threadContext[i].finishtime = finishtime;
-
-    CALLOC(threadContext[i].randomBuffer, threadContext[i].highBlockSize, 1);
-    memset(threadContext[i].randomBuffer, 0, threadContext[i].highBlockSize);
-    generateRandomBufferCyclic(threadContext[i].randomBuffer, threadContext[i].highBlockSize, threadContext[i].seed, threadContext[i].highBlockSize); 
   }
 
   
+  // --iolog, the jobs push every completion and a writer streams them out
+  positionLogWriterType ioLog;
+  if (options->ioLogPrefix) {
+    size_t *bdSizes;
+    unsigned short *seeds;
+    char *prefix;
+    CALLOC(bdSizes, num, sizeof(size_t));
+    CALLOC(seeds, num, sizeof(unsigned short));
+    CALLOC(prefix, strlen(options->ioLogPrefix) + 30, 1);
+    for (size_t i = 0; i < num; i++) {
+      bdSizes[i] = threadContext[i].bdSize;
+      seeds[i] = threadContext[i].seed;
+    }
+    if (ioLogRuns++) {
+      sprintf(prefix, "%s-run%zd", options->ioLogPrefix, ioLogRuns);
+    } else {
+      strcpy(prefix, options->ioLogPrefix);
+    }
+    if (positionLogWriterStart(&ioLog, prefix, threadContext[0].allPC, num, bdSizes, seeds)) {
+      exit(-1);
+    }
+    free(bdSizes);
+    free(seeds);
+    free(prefix);
+  }
+
   // use the device and timing info from context[0]
+  timing->runStart = timedouble();
+  timerRunning = 1;
   pthread_create(&(pt[num]), NULL, runThreadTimer, &(threadContext[0]));
   for (size_t i = 0; i < num; i++) {
     pthread_create(&(pt[i]), NULL, runThread, &(threadContext[i]));
   }
+  if (options->control) {
+    controlStart(options->control, threadContext[0].allPC, num);
+  }
+  if (options->metrics) {
+    metricsStart(options->metrics, threadContext[0].allPC, num);
+  }
 
   // wait for all threads
   for (size_t i = 0; i < num; i++) {
     pthread_join(pt[i], NULL);
   }
-  keepRunning = 0; // the 
-  // now wait for the timer thread (probably don't need this)
+  timerRunning = 0; // the workers are done, stop the timer
   pthread_join(pt[num], NULL);
+  if (options->control) {
+    controlStop(options->control);
+  }
+  if (options->metrics) {
+    metricsStop(options->metrics);
+  }
+  timing->runFinish = timedouble();
+  if (options->ioLogPrefix) {
+    const size_t dropped = positionLogWriterStop(&ioLog);
+    for (size_t i = 0; i < num; i++) {
+      threadContext[i].pos.ioLog = NULL;
+    }
+    if (dropped) {
+      fprintf(stderr,"*warning* the I/O log dropped %zd records, the disk didn't keep up\n", dropped);
+    }
+  }
+  steadyStatePrint(stderr, &timing->steady, timing->runFinish - timing->runStart);
+  steadyStateFree(&timing->steady); // the results are kept
 
-    
+  free(pt);
+}
+
+
+// the per job summaries, positions files and -J results
+void jobReportThreads(threadInfoType *threadContext, const int num, const size_t maxSizeInBytes,
+		      const size_t timetorun, const jobOptionsType *options, const resultsTimingType *timing) {
   // print stats 
   for (size_t i = 0; i < num; i++) {
     if (!threadContext[i].random) {
       positionLatencyStats(&threadContext[i].pos, i);
     }
+    positionRampStats(&threadContext[i].pos, i);
+    positionCPUStats(&threadContext[i].pos, i);
+    if (options->perfCounters) {
+      perfCountersPrint(stderr, &threadContext[i].perf, i, threadContext[i].jobstring, threadContext[i].pos.readIOs + threadContext[i].pos.writtenIOs);
+    }
+  }
+
+  // per device and all devices
+  if (options->numDevices > 1 || options->stripeChunk) {
+    deviceTotalType *totals, all;
+    CALLOC(totals, num + options->numDevices, sizeof(deviceTotalType));
+    const size_t n = jobDeviceTotals(threadContext, num, totals);
+    double maxElapsed = 0;
+    for (size_t i = 0; i < num; i++) {
+      if (threadContext[i].pos.elapsedTime > maxElapsed) maxElapsed = threadContext[i].pos.elapsedTime;
+    }
+    memset(&all, 0, sizeof(deviceTotalType));
+    all.name = "all";
+    for (size_t d = 0; d < n; d++) {
+      jobPrintDeviceLine(stderr, &totals[d], NULL, maxElapsed);
+      all.jobs += totals[d].jobs;
+      all.readBytes += totals[d].readBytes;
+      all.readIOs += totals[d].readIOs;
+      all.writtenBytes += totals[d].writtenBytes;
+      all.writtenIOs += totals[d].writtenIOs;
+    }
+    jobPrintDeviceLine(stderr, &all, NULL, maxElapsed);
+    free(totals);
   }
 
   //        if (logPositions) {
   for (size_t i = 0; i < num; i++) {
     char s[1000];
-    sprintf(s, "spit-positions-%03zd.txt", i);
+    sprintf(s, "spit-positions-%03zd.%s", i, options->positionsText ? "txt" : "bin");
     fprintf(stderr, "*info* writing positions to '%s'\n", s); 
-    positionContainerSave(&threadContext[i].pos, s, threadContext[i].bdSize, 0);
+    if (options->positionsText) {
+      positionContainerSave(&threadContext[i].pos, s, threadContext[i].bdSize, 0);
+    } else {
+      positionLogSave(&threadContext[i].pos, s, threadContext[i].bdSize, 0, threadContext[i].seed);
+    }
   }
   //    } 
 
+  if (options->resultsFilename) {
+    resultsWriteJSON(options->resultsFilename, threadContext, num, options, maxSizeInBytes, timetorun, timing);
+  }
+}
+
 
-  
-  // free
+void jobFreeThreads(threadInfoType *threadContext, const int num) {
   for (size_t i = 0; i < num; i++) {
+    if (threadContext[i].stripe.count) {
+      stripeClose(&threadContext[i].stripe);
+    } else if (threadContext[i].fd >= 0) {
+      close(threadContext[i].fd);
+    }
+    if (threadContext[i].ioeQD) {
+      ioEngineDestroy(&threadContext[i].ioe);
+    }
     positionContainerFree(&threadContext[i].pos);
     free(threadContext[i].randomBuffer);
   }
 
-  free(allThreadsPC);
+  free(threadContext[0].allPC);
   free(threadContext);
-  free(pt);
+}
+
+
+// --precondition each device once, on the jobs' fds, before the test
+int jobPrecondition(threadInfoType *threadContext, const int num, resultsTimingType *timing) {
+  const preconditionType *p = &threadContext[0].options->precondition;
+  timing->precondition = 0;
+  timing->preconditionBytes = 0;
+  if (!preconditionEnabled(p)) return 0;
+
+  // a striped job's members are each done in turn
+  if (threadContext[0].stripe.count) {
+    const stripeType *st = &threadContext[0].stripe;
+    for (size_t m = 0; m < st->count && keepRunning; m++) {
+      size_t bytes = 0;
+      const double t = preconditionDevice(p, threadContext[0].options->devices[m], st->fds[m], threadContext[0].engine, threadContext[0].bdSize / st->count, &bytes);
+      if (t < 0) {
+	return 1;
+      }
+      timing->precondition += t;
+      timing->preconditionBytes += bytes;
+    }
+    return 0;
+  }
+
+  for (size_t i = 0; i < num && keepRunning; i++) {
+    int seen = 0;
+    for (size_t k = 0; k < i; k++) {
+      if (strcmp(threadContext[k].jobdevice, threadContext[i].jobdevice) == 0) seen = 1;
+    }
+    if (seen) continue;
+
+    size_t bytes = 0;
+    const double t = preconditionDevice(p, threadContext[i].jobdevice, threadContext[i].fd, threadContext[i].engine, threadContext[i].bdSize, &bytes);
+    if (t < 0) {
+      return 1;
+    }
+    timing->precondition += t;
+    timing->preconditionBytes += bytes;
+  }
+  return 0;
+}
+
+
+void jobRunThreads(jobType *job, const int num, const size_t maxSizeInBytes,
+		   const size_t timetorun, const size_t dumpPos, const jobOptionsType *options) {
+  resultsTimingType timing;
+  timing.setupStart = timedouble();
+
+  threadInfoType *threadContext = jobSetupThreads(job, num, maxSizeInBytes, timetorun, dumpPos, options);
+  if (jobPrecondition(threadContext, num, &timing) == 0) {
+    jobRunPrepared(threadContext, num, timetorun, &timing);
+    jobReportThreads(threadContext, num, maxSizeInBytes, timetorun, options, &timing);
+  }
+  jobFreeThreads(threadContext, num);
 }
 
 
@@ -587,4 +1090,68 @@ void jobAddDeviceToAll(jobType *job, const char *device) {
     job->devices[i] = strdup(device);
   }
 }
+
+
+// each job on every device, or on a stripe of all of them
+void jobAssignDevices(jobType *job, const jobOptionsType *options) {
+  if (options->stripeChunk) {
+    size_t len = 100;
+    for (size_t d = 0; d < options->numDevices; d++) {
+      len += strlen(options->devices[d]) + 1;
+    }
+    char *label = malloc(len), *p = label;
+    p += sprintf(p, "stripe:%zdk:", options->stripeChunk / 1024);
+    for (size_t d = 0; d < options->numDevices; d++) {
+      p += sprintf(p, "%s%s", d ? "," : "", options->devices[d]);
+    }
+    jobAddDeviceToAll(job, label);
+    free(label);
+  } else if (options->numDevices == 1) {
+    jobAddDeviceToAll(job, options->devices[0]);
+  } else {
+    jobType all;
+    jobInit(&all);
+    for (size_t i = 0; i < job->count; i++) {
+      for (size_t d = 0; d < options->numDevices; d++) {
+	jobAddBoth(&all, options->devices[d], job->strings[i]);
+      }
+    }
+    jobFree(job);
+    *job = all;
+  }
+}
+
+
+static void deviceTotalAdd(deviceTotalType *totals, size_t *count, const char *name, const size_t rb, const size_t ri, const size_t wb, const size_t wi) {
+  size_t k = 0;
+  while (k < *count && strcmp(totals[k].name, name) != 0) k++;
+  if (k == *count) {
+    memset(&totals[k], 0, sizeof(deviceTotalType));
+    totals[k].name = name;
+    (*count)++;
+  }
+  totals[k].jobs++;
+  totals[k].readBytes += rb;
+  totals[k].readIOs += ri;
+  totals[k].writtenBytes += wb;
+  totals[k].writtenIOs += wi;
+}
+
+/* the totals of each device, in the order they're first used. totals has
+ * room for num + the number of devices */
+size_t jobDeviceTotals(const threadInfoType *tc, const size_t num, deviceTotalType *totals) {
+  size_t count = 0;
+  for (size_t i = 0; i < num; i++) {
+    const stripeType *st = &tc[i].stripe;
+    if (st->count) {
+      for (size_t m = 0; m < st->count; m++) {
+	deviceTotalAdd(totals, &count, tc[i].options->devices[m], st->readBytes[m], st->readIOs[m], st->writtenBytes[m], st->writtenIOs[m]);
+      }
+    } else {
+      const positionContainer *pc = &tc[i].pos;
+      deviceTotalAdd(totals, &count, tc[i].jobdevice, pc->readBytes, pc->readIOs, pc->writtenBytes, pc->writtenIOs);
+    }
+  }
+  return count;
+}
     
@@ -3,20 +3,117 @@
 
 #include <stdlib.h>
 
+#include "positions.h"
+#include "perfCounters.h"
+#include "steadyState.h"
+#include "precondition.h"
+#include "statsStream.h"
+#include "control.h"
+#include "metrics.h"
+#include "ioEngine.h"
+
 typedef struct {
   int count;
   char **strings;
   char **devices;
 } jobType;
- 
+
+// run wide reporting options, set from the command line
+typedef struct {
+  double sampleInterval;  // seconds between time series samples
+  char *timeSeriesPrefix; // per job time series files, NULL for none
+  char *resultsFilename;  // JSON results document, NULL for none
+  char *commandLine;      // for the results
+  int perfCounters;       // open perf_event counters around each job
+  char *sweep;            // --sweep specification, NULL for a normal run
+  size_t sweepWarmup;     // --warmup seconds before each sweep cell
+  size_t steadyWindow;    // -S seconds, end a run at steady state, 0 for off
+  double steadyExcursion;
+  double steadySlope;
+  preconditionType precondition; // --precondition, none if no passes
+  int createFill;         // write random data into files spit creates
+  char **devices;         // the -f devices
+  size_t numDevices;
+  size_t stripeChunk;     // bytes, stripe each job over all the devices, 0 for not
+  int live;               // a line per job every second as well
+  statsStreamType *stream; // --stream NDJSON, NULL for none
+  controlType *control;   // --control socket, NULL for none
+  metricsType *metrics;   // --metrics endpoint, NULL for none
+  int positionsText;      // the positions as the old text format, not binary
+  char *ioLogPrefix;      // --iolog, stream every I/O to prefix-NNN.bin, NULL for not
+} jobOptionsType;
+
+// wall clock times of the phases of a run
+typedef struct {
+  double setupStart;
+  double runStart;
+  double runFinish;
+  steadyStateType steady;
+  double precondition;    // seconds, 0 if not
+  size_t preconditionBytes;
+} resultsTimingType;
+
+// the per job (thread) settings parsed from the job string and its run state
+typedef struct {
+  size_t id;
+  positionContainer pos;
+  size_t bdSize;
+  double finishtime;
+  size_t waitfor;
+  char *jobstring;
+  char *jobdevice;
+  size_t blockSize;
+  size_t highBlockSize;
+  size_t queueDepth;
+  size_t flushEvery;
+  float rw;
+  size_t random;
+  unsigned short seed;
+  char *randomBuffer;
+  size_t numThreads;
+  positionContainer **allPC;
+  size_t anywrites;
+  size_t UUID;
+  const jobOptionsType *options;
+  int seqFiles;
+  size_t metaData;
+  size_t limit;
+  int direct;
+  int engine;             // IOENGINEAIO, IOENGINENULL or IOENGINESIM
+  int fd;                 // -1 if the engine doesn't use the device
+  ioEngineType ioe;       // opened with the fd, kept for the precondition and every run
+  size_t ioeQD;           // what ioe has room for, 0 if it's not open
+  stripeType stripe;      // the devices of a striped job
+  perfCountersType perf;
+  steadyStateType *steady; // the run's, updated by the timer
+} threadInfoType;
+
+// what a device did, over all the jobs and stripes it's in
+typedef struct {
+  const char *name;
+  size_t jobs;
+  size_t readBytes;
+  size_t readIOs;
+  size_t writtenBytes;
+  size_t writtenIOs;
+} deviceTotalType;
+
 
 void jobInit(jobType *j);
 void jobAdd(jobType *j, const char *jobstring);
 void jobDump(jobType *j);
 void jobFree(jobType *j);
-void jobRunThreads(jobType *j, const int num, const size_t maxSizeInBytes, const size_t timetorun, const size_t dumpPositions);
+void jobOptionsInit(jobOptionsType *o);
+void jobRunThreads(jobType *j, const int num, const size_t maxSizeInBytes, const size_t timetorun, const size_t dumpPositions, const jobOptionsType *options);
+threadInfoType *jobSetupThreads(jobType *j, const int num, const size_t maxSizeInBytes, const size_t timetorun, const size_t dumpPositions, const jobOptionsType *options);
+int  jobPrecondition(threadInfoType *tc, const int num, resultsTimingType *timing);
+void jobRunPrepared(threadInfoType *tc, const int num, const size_t timetorun, resultsTimingType *timing);
+void jobReportThreads(threadInfoType *tc, const int num, const size_t maxSizeInBytes, const size_t timetorun, const jobOptionsType *options, const resultsTimingType *timing);
+void jobFreeThreads(threadInfoType *tc, const int num);
 void jobMultiply(jobType *j, const size_t extrajobs);
 void jobAddDeviceToAll(jobType *j, const char *device);
+void jobAssignDevices(jobType *j, const jobOptionsType *options);
+size_t jobDeviceTotals(const threadInfoType *tc, const size_t num, deviceTotalType *totals);
 
 #endif
 
@@ -0,0 +1,94 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveStats.h"
+#include "utils.h"
+
+void liveStatsInit(liveStatsType *l, const positionContainer *pc) {
+  memset(l, 0, sizeof(liveStatsType));
+  l->lastReadBytes = pc->readBytes;
+  l->lastWrittenBytes = pc->writtenBytes;
+  l->lastReadIOs = pc->readIOs;
+  l->lastWrittenIOs = pc->writtenIOs;
+  memcpy(&l->lastRead, &pc->readLatency, sizeof(histogramType));
+  memcpy(&l->lastWrite, &pc->writeLatency, sizeof(histogramType));
+}
+
+
+/* the interval since the last call. The totals are read without a lock,
+ * like the rest of the timer, so each histogram is copied once and both
+ * the delta and the next last come from the copy */
+void liveStatsUpdate(liveStatsType *l, const positionContainer *pc, const double period) {
+  const size_t rb = pc->readBytes, wb = pc->writtenBytes, ri = pc->readIOs, wi = pc->writtenIOs;
+  histogramType snap;
+
+  l->period = period;
+  l->readBytes = rb - l->lastReadBytes;
+  l->writtenBytes = wb - l->lastWrittenBytes;
+  l->readIOs = ri - l->lastReadIOs;
+  l->writtenIOs = wi - l->lastWrittenIOs;
+  l->inFlight = pc->inFlight;
+
+  memcpy(&snap, &pc->readLatency, sizeof(histogramType));
+  histogramDelta(&l->read, &snap, &l->lastRead);
+  memcpy(&l->lastRead, &snap, sizeof(histogramType));
+  memcpy(&snap, &pc->writeLatency, sizeof(histogramType));
+  histogramDelta(&l->write, &snap, &l->lastWrite);
+  memcpy(&l->lastWrite, &snap, sizeof(histogramType));
+
+  l->lastReadBytes = rb;
+  l->lastWrittenBytes = wb;
+  l->lastReadIOs = ri;
+  l->lastWrittenIOs = wi;
+}
+
+
+static void liveStatsDirection(FILE *fp, const char *name, const size_t bytes, const size_t ios, const histogramType *h, const double period) {
+  fprintf(fp, "%s ", name);
+  commaPrint0dp(fp, TOMiB(bytes) / period);
+  fprintf(fp, " MiB/s (");
+  commaPrint0dp(fp, ios / period);
+  fprintf(fp, " IOPS / %zd)", ios ? bytes / ios : 0);
+  if (h->count) {
+    fprintf(fp, " P50/99/99.9 %.0lf/%.0lf/%.0lf us", histogramPercentile(h, 50) * 1000000.0, histogramPercentile(h, 99) * 1000000.0, histogramPercentile(h, 99.9) * 1000000.0);
+  }
+}
+
+// one line per job, under the aggregate line
+void liveStatsPrint(FILE *fp, const liveStatsType *l, const size_t id, const char *jobstring) {
+  const double period = (l->period > 0) ? l->period : 1;
+  fprintf(fp, "        [T%zd] '%s': ", id, jobstring);
+  liveStatsDirection(fp, "read", l->readBytes, l->readIOs, &l->read, period);
+  liveStatsDirection(fp, ", write", l->writtenBytes, l->writtenIOs, &l->write, period);
+  fprintf(fp, ", inflight %zd\n", l->inFlight);
+}
+
+
+// the interval of several jobs, total starts zeroed
+void liveStatsSum(liveStatsType *total, const liveStatsType *l) {
+  total->period = l->period;
+  total->readBytes += l->readBytes;
+  total->writtenBytes += l->writtenBytes;
+  total->readIOs += l->readIOs;
+  total->writtenIOs += l->writtenIOs;
+  total->inFlight += l->inFlight;
+  histogramMerge(&total->read, &l->read);
+  histogramMerge(&total->write, &l->write);
+}
+
+
+static void liveStatsDirectionJSON(FILE *fp, const char *name, const size_t bytes, const size_t ios, const histogramType *h, const double period) {
+  fprintf(fp, "\"%sMiBs\": %.2lf, \"%sIOPS\": %.0lf, \"%sP50us\": %.0lf, \"%sP99us\": %.0lf, \"%sP999us\": %.0lf, ",
+	  name, TOMiB(bytes) / period, name, ios / period,
+	  name, histogramPercentile(h, 50) * 1000000.0, name, histogramPercentile(h, 99) * 1000000.0, name, histogramPercentile(h, 99.9) * 1000000.0);
+}
+
+// the fields of an object, the caller adds the braces
+void liveStatsJSON(FILE *fp, const liveStatsType *l) {
+  const double period = (l->period > 0) ? l->period : 1;
+  liveStatsDirectionJSON(fp, "read", l->readBytes, l->readIOs, &l->read, period);
+  liveStatsDirectionJSON(fp, "write", l->writtenBytes, l->writtenIOs, &l->write, period);
+  fprintf(fp, "\"inFlight\": %zd", l->inFlight);
+}
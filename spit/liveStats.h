@@ -0,0 +1,34 @@
+#ifndef _LIVESTATS_H
+#define _LIVESTATS_H
+
+#include <stdio.h>
+
+#include "positions.h"
+#include "histogram.h"
+
+// a job's values over the last interval, from its running totals
+typedef struct {
+  size_t lastReadBytes;
+  size_t lastWrittenBytes;
+  size_t lastReadIOs;
+  size_t lastWrittenIOs;
+  histogramType lastRead;
+  histogramType lastWrite;
+  // the interval
+  double period;
+  size_t readBytes;
+  size_t writtenBytes;
+  size_t readIOs;
+  size_t writtenIOs;
+  size_t inFlight;
+  histogramType read;
+  histogramType write;
+} liveStatsType;
+
+void liveStatsInit(liveStatsType *l, const positionContainer *pc);
+void liveStatsUpdate(liveStatsType *l, const positionContainer *pc, const double period);
+void liveStatsPrint(FILE *fp, const liveStatsType *l, const size_t id, const char *jobstring);
+void liveStatsSum(liveStatsType *total, const liveStatsType *l);
+void liveStatsJSON(FILE *fp, const liveStatsType *l);
+
+#endif
@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+#include "utils.h"
+
+// the le="" bucket bounds in microseconds, the histogram buckets are mapped onto them
+static const size_t metricsBounds[] = {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+#define METRICSBOUNDS (sizeof(metricsBounds) / sizeof(metricsBounds[0]))
+
+
+// a number is a TCP port on 127.0.0.1, anything else a Unix socket path. Returns 0 if listening
+int metricsOpen(metricsType *m, const char *where) {
+  memset(m, 0, sizeof(metricsType));
+  m->fd = -1;
+
+  char *endp = NULL;
+  const long port = strtol(where, &endp, 10);
+  if (*where && *endp == 0) {
+    if (port <= 0 || port > 65535) {
+      fprintf(stderr,"*error* --metrics port %ld is out of range\n", port);
+      return 1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int one = 1;
+    m->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m->fd >= 0) setsockopt(m->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (m->fd < 0 || bind(m->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(m->fd, 16) != 0) {
+      perror(where);
+      if (m->fd >= 0) close(m->fd);
+      m->fd = -1;
+      return 1;
+    }
+    fprintf(stderr,"*info* Prometheus metrics on http://127.0.0.1:%ld/metrics\n", port);
+  } else {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(where) >= sizeof(addr.sun_path)) {
+      fprintf(stderr,"*error* the metrics socket path '%s' is too long\n", where);
+      return 1;
+    }
+    strcpy(addr.sun_path, where);
+    struct stat st;
+    if (stat(where, &st) == 0 && S_ISSOCK(st.st_mode)) {
+      unlink(where); // from a previous run
+    }
+    m->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m->fd < 0 || bind(m->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(m->fd, 16) != 0) {
+      perror(where);
+      if (m->fd >= 0) close(m->fd);
+      m->fd = -1;
+      return 1;
+    }
+    m->path = strdup(where);
+    fprintf(stderr,"*info* Prometheus metrics on the Unix socket '%s'\n", where);
+  }
+  signal(SIGPIPE, SIG_IGN); // a scraper going away is an EPIPE
+  return 0;
+}
+
+
+// a label value, with \ " and newlines escaped
+static void metricsLabel(FILE *fp, const char *s) {
+  fputc('"', fp);
+  for (; s && *s; s++) {
+    if (*s == '\\' || *s == '"') {
+      fputc('\\', fp);
+      fputc(*s, fp);
+    } else if (*s == '\n') {
+      fputs("\\n", fp);
+    } else {
+      fputc(*s, fp);
+    }
+  }
+  fputc('"', fp);
+}
+
+static void metricsLabels(FILE *fp, const positionContainer *pc, const size_t id) {
+  fprintf(fp, "spit_job=\"%zd\",string=", id); // job is the scrape target label
+  metricsLabel(fp, pc->string);
+  fprintf(fp, ",device=");
+  metricsLabel(fp, pc->device);
+}
+
+static void metricsHeader(FILE *fp, const char *name, const char *type, const char *help) {
+  fprintf(fp, "# HELP spit_%s %s\n# TYPE spit_%s %s\n", name, help, name, type);
+}
+
+// a counter or gauge per job, the value is at offset in the positionContainer
+static void metricsValue(FILE *fp, const metricsType *m, const char *name, const char *type, const char *help, const size_t offset) {
+  metricsHeader(fp, name, type, help);
+  for (size_t i = 0; i < m->num; i++) {
+    const positionContainer *pc = m->pcs[i];
+    fprintf(fp, "spit_%s{", name);
+    metricsLabels(fp, pc, i);
+    fprintf(fp, "} %zd\n", *(const size_t*)((const char*)pc + offset));
+  }
+}
+
+// cumulative buckets, a histogram bucket is counted when all of it is <= the bound
+static void metricsHistogram(FILE *fp, const metricsType *m, const char *name, const char *help, const size_t offset, histogramType *h) {
+  metricsHeader(fp, name, "histogram", help);
+  for (size_t i = 0; i < m->num; i++) {
+    const positionContainer *pc = m->pcs[i];
+    memcpy(h, (const char*)pc + offset, sizeof(histogramType)); // a snapshot, the job keeps adding
+    size_t b = 0, cumulative = 0;
+    for (size_t k = 0; k < METRICSBOUNDS; k++) {
+      while (b < HISTOGRAMBUCKETS && histogramBucketHigh(b) <= metricsBounds[k] + 1) {
+	cumulative += h->bucket[b++];
+      }
+      fprintf(fp, "spit_%s_bucket{", name);
+      metricsLabels(fp, pc, i);
+      fprintf(fp, ",le=\"%g\"} %zd\n", metricsBounds[k] / 1000000.0, cumulative);
+    }
+    size_t count = 0;
+    for (size_t k = 0; k < HISTOGRAMBUCKETS; k++) {
+      count += h->bucket[k];
+    }
+    fprintf(fp, "spit_%s_bucket{", name);
+    metricsLabels(fp, pc, i);
+    fprintf(fp, ",le=\"+Inf\"} %zd\nspit_%s_sum{", count, name);
+    metricsLabels(fp, pc, i);
+    fprintf(fp, "} %.6lf\nspit_%s_count{", h->sumus / 1000000.0, name);
+    metricsLabels(fp, pc, i);
+    fprintf(fp, "} %zd\n", count);
+  }
+}
+
+
+static void metricsPage(FILE *fp, const metricsType *m) {
+  histogramType *h;
+  CALLOC(h, 1, sizeof(histogramType));
+
+  metricsHeader(fp, "run_seconds", "gauge", "Seconds since the current run started.");
+  fprintf(fp, "spit_run_seconds %.3lf\n", timedouble() - m->start);
+  metricsHeader(fp, "jobs", "gauge", "Jobs in the current run.");
+  fprintf(fp, "spit_jobs %zd\n", m->num);
+
+  // the raw totals, the measured ones drop when the warm-up and cool-down are taken out
+  metricsValue(fp, m, "read_bytes_total", "counter", "Bytes read, with the warm-up and cool-down.", offsetof(positionContainer, allReadBytes));
+  metricsValue(fp, m, "written_bytes_total", "counter", "Bytes written, with the warm-up and cool-down.", offsetof(positionContainer, allWrittenBytes));
+  metricsValue(fp, m, "read_ios_total", "counter", "Reads submitted, with the warm-up and cool-down.", offsetof(positionContainer, allReadIOs));
+  metricsValue(fp, m, "written_ios_total", "counter", "Writes submitted, with the warm-up and cool-down.", offsetof(positionContainer, allWrittenIOs));
+  metricsValue(fp, m, "errors_total", "counter", "I/Os that failed.", offsetof(positionContainer, errors));
+  metricsValue(fp, m, "flushes_total", "counter", "Flushes completed.", offsetof(positionContainer, flushLatency) + offsetof(histogramType, count));
+  metricsValue(fp, m, "in_flight", "gauge", "I/Os submitted and not completed.", offsetof(positionContainer, inFlight));
+
+  metricsHistogram(fp, m, "read_latency_seconds", "Read latency, without the warm-up and cool-down.", offsetof(positionContainer, readLatency), h);
+  metricsHistogram(fp, m, "write_latency_seconds", "Write latency, without the warm-up and cool-down.", offsetof(positionContainer, writeLatency), h);
+  metricsHistogram(fp, m, "flush_latency_seconds", "Flush latency.", offsetof(positionContainer, flushLatency), h);
+  free(h);
+}
+
+
+// answer one request, whatever the path
+static void metricsServe(const metricsType *m, const int client) {
+  char req[4096];
+  struct pollfd pfd;
+  pfd.fd = client;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 1000) <= 0 || read(client, req, sizeof(req)) <= 0) {
+    return; // no request in a second
+  }
+
+  char *body = NULL;
+  size_t len = 0;
+  FILE *fp = open_memstream(&body, &len);
+  if (!fp) {
+    return;
+  }
+  metricsPage(fp, m);
+  fclose(fp);
+
+  char header[200];
+  const int hlen = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zd\r\nConnection: close\r\n\r\n", len);
+  if (write(client, header, hlen) == hlen) {
+    size_t done = 0;
+    while (done < len) {
+      const ssize_t w = write(client, body + done, len - done);
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) break;
+      done += w;
+    }
+  }
+  free(body);
+}
+
+
+static void *metricsThread(void *arg) {
+  metricsType *m = (metricsType*)arg;
+  while (m->running) {
+    struct pollfd pfd;
+    pfd.fd = m->fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 100) <= 0) {
+      continue;
+    }
+    const int client = accept(m->fd, NULL, NULL);
+    if (client >= 0) {
+      metricsServe(m, client);
+      close(client);
+    }
+  }
+  return NULL;
+}
+
+
+// serve the jobs of a run until metricsStop
+void metricsStart(metricsType *m, positionContainer **pcs, const size_t num) {
+  if (m->fd < 0) {
+    return;
+  }
+  m->pcs = pcs;
+  m->num = num;
+  m->start = timedouble();
+  m->running = 1;
+  pthread_create(&m->thread, NULL, metricsThread, m);
+}
+
+
+void metricsStop(metricsType *m) {
+  if (m->running) {
+    m->running = 0;
+    pthread_join(m->thread, NULL);
+  }
+}
+
+
+void metricsClose(metricsType *m) {
+  metricsStop(m);
+  if (m->fd >= 0) {
+    close(m->fd);
+    m->fd = -1;
+    if (m->path) {
+      unlink(m->path);
+    }
+  }
+  free(m->path);
+  m->path = NULL;
+}
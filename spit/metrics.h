@@ -0,0 +1,26 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <pthread.h>
+
+#include "positions.h"
+
+/* --metrics port|path, the Prometheus text format over HTTP on a local TCP
+ * port (127.0.0.1) or a Unix domain socket. Every request is answered
+ * with the counters of the current run's jobs */
+typedef struct {
+  int fd;                    // listening, -1 if not open
+  char *path;                // the Unix socket, NULL for TCP
+  volatile int running;
+  pthread_t thread;
+  positionContainer **pcs;   // the jobs of the current run
+  size_t num;
+  double start;
+} metricsType;
+
+int  metricsOpen(metricsType *m, const char *where);
+void metricsStart(metricsType *m, positionContainer **pcs, const size_t num);
+void metricsStop(metricsType *m);
+void metricsClose(metricsType *m);
+
+#endif
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfCounters.h"
+
+/**
+ * perfCounters.c
+ *
+ * per thread CPU counters around a job's I/O, so the cost of an I/O can
+ * be split into cycles, IPC, cache and TLB misses
+ *
+ */
+
+static const char *perfNames[PERFCOUNTERS] = {"cycles", "instructions", "cacheMisses", "dTLBMisses", "ctxSwitches"};
+
+const char *perfCounterName(const int counter) {
+  return perfNames[counter];
+}
+
+
+void perfCountersInit(perfCountersType *p) {
+  memset(p, 0, sizeof(perfCountersType));
+  for (size_t i = 0; i < PERFCOUNTERS; i++) {
+    p->fd[i] = -1;
+  }
+}
+
+
+static int perfEventOpen(const unsigned int type, const unsigned long long config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  // this thread, any CPU
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+
+// open the counters for the calling thread, returns the number that opened
+int perfCountersOpen(perfCountersType *p) {
+  perfCountersInit(p);
+
+  p->fd[PERFCYCLES] = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  p->fd[PERFINSTRUCTIONS] = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  p->fd[PERFCACHEMISSES] = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  p->fd[PERFDTLBMISSES] = perfEventOpen(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  p->fd[PERFCTXSWITCHES] = perfEventOpen(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+
+  int opened = 0;
+  for (size_t i = 0; i < PERFCOUNTERS; i++) {
+    if (p->fd[i] >= 0) opened++;
+  }
+  return opened;
+}
+
+
+void perfCountersStart(perfCountersType *p) {
+  for (size_t i = 0; i < PERFCOUNTERS; i++) {
+    if (p->fd[i] >= 0) {
+      ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+
+// stop and read the counters, scaling up if the PMU was shared with other events
+void perfCountersStop(perfCountersType *p) {
+  p->anyValid = 0;
+  for (size_t i = 0; i < PERFCOUNTERS; i++) {
+    p->valid[i] = 0;
+    p->value[i] = 0;
+    if (p->fd[i] >= 0) {
+      ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+      uint64_t v[3]; // value, time enabled, time running
+      if (read(p->fd[i], v, sizeof(v)) == sizeof(v) && v[2] > 0) {
+	p->value[i] = (v[2] < v[1]) ? v[0] * ((double)v[1] / v[2]) : v[0];
+	p->valid[i] = 1;
+	p->anyValid = 1;
+      }
+    }
+  }
+}
+
+
+void perfCountersClose(perfCountersType *p) {
+  for (size_t i = 0; i < PERFCOUNTERS; i++) {
+    if (p->fd[i] >= 0) close(p->fd[i]);
+    p->fd[i] = -1;
+  }
+}
+
+
+void perfCountersPrint(FILE *fp, const perfCountersType *p, const int threadid, const char *label, const size_t ios) {
+  if (!p->anyValid) {
+    fprintf(fp, "*info* [T%d] '%s': perf counters not available\n", threadid, label);
+    return;
+  }
+
+  fprintf(fp, "*info* [T%d] '%s': perf per IO:", threadid, label);
+  for (size_t i = 0; i < PERFCOUNTERS; i++) {
+    if (p->valid[i]) {
+      fprintf(fp, " %s %.2lf", perfNames[i], ios ? p->value[i] / ios : 0);
+    } else {
+      fprintf(fp, " %s n/a", perfNames[i]);
+    }
+  }
+  if (p->valid[PERFCYCLES] && p->valid[PERFINSTRUCTIONS] && p->value[PERFCYCLES] > 0) {
+    fprintf(fp, ", IPC %.2lf", p->value[PERFINSTRUCTIONS] / p->value[PERFCYCLES]);
+  }
+  fprintf(fp, "\n");
+}
+
+
+// totals and per I/O values, null for counters that couldn't be read
+void perfCountersJSON(FILE *fp, const perfCountersType *p, const size_t ios) {
+  fprintf(fp, "{");
+  for (size_t i = 0; i < PERFCOUNTERS; i++) {
+    if (p->valid[i]) {
+      fprintf(fp, "\"%s\": %.0lf, \"%sPerIO\": %.3lf, ", perfNames[i], p->value[i], perfNames[i], ios ? p->value[i] / ios : 0);
+    } else {
+      fprintf(fp, "\"%s\": null, \"%sPerIO\": null, ", perfNames[i], perfNames[i]);
+    }
+  }
+  if (p->valid[PERFCYCLES] && p->valid[PERFINSTRUCTIONS] && p->value[PERFCYCLES] > 0) {
+    fprintf(fp, "\"IPC\": %.3lf}", p->value[PERFINSTRUCTIONS] / p->value[PERFCYCLES]);
+  } else {
+    fprintf(fp, "\"IPC\": null}");
+  }
+}
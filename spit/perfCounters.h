@@ -0,0 +1,30 @@
+#ifndef _PERFCOUNTERS_H
+#define _PERFCOUNTERS_H
+
+#include <stdio.h>
+
+// the per thread hardware/software counters, opened with perf_event_open
+#define PERFCYCLES 0
+#define PERFINSTRUCTIONS 1
+#define PERFCACHEMISSES 2
+#define PERFDTLBMISSES 3
+#define PERFCTXSWITCHES 4
+#define PERFCOUNTERS 5
+
+typedef struct {
+  int fd[PERFCOUNTERS];        // -1 if the counter couldn't be opened
+  double value[PERFCOUNTERS];  // scaled if the counter was multiplexed
+  int valid[PERFCOUNTERS];
+  int anyValid;
+} perfCountersType;
+
+const char *perfCounterName(const int counter);
+void perfCountersInit(perfCountersType *p);
+int  perfCountersOpen(perfCountersType *p);
+void perfCountersStart(perfCountersType *p);
+void perfCountersStop(perfCountersType *p);
+void perfCountersClose(perfCountersType *p);
+void perfCountersPrint(FILE *fp, const perfCountersType *p, const int threadid, const char *label, const size_t ios);
+void perfCountersJSON(FILE *fp, const perfCountersType *p, const size_t ios);
+
+#endif
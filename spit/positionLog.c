@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "positionLog.h"
+#include "utils.h"
+
+
+static int positionLogWrite(const int fd, const void *buf, const size_t len, const char *name) {
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t w = write(fd, (const char*)buf + done, len - done);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      perror(name);
+      return 1;
+    }
+    done += w;
+  }
+  return 0;
+}
+
+
+// returns 0 if open, the header is written with a count of 0
+int positionLogOpen(positionLogType *l, const char *name, const positionContainer *pc, const size_t bdSize, const unsigned short seed) {
+  memset(l, 0, sizeof(positionLogType));
+  l->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (l->fd < 0) {
+    perror(name);
+    return 1;
+  }
+  l->name = strdup(name);
+
+  positionLogHeaderType *h = &l->header;
+  memcpy(h->magic, POSITIONLOGMAGIC, sizeof(h->magic));
+  h->version = POSITIONLOGVERSION;
+  h->recordSize = sizeof(positionLogRecordType);
+  h->headerSize = POSITIONLOGHEADER;
+  h->UUID = pc->UUID;
+  h->bdSize = bdSize;
+  h->seed = seed;
+  h->jobId = pc->jobId;
+  if (pc->device) strncpy(h->device, pc->device, sizeof(h->device) - 1);
+  if (pc->string) strncpy(h->string, pc->string, sizeof(h->string) - 1);
+
+  char *block;
+  CALLOC(block, POSITIONLOGHEADER, 1);
+  memcpy(block, h, sizeof(positionLogHeaderType));
+  const int ret = positionLogWrite(l->fd, block, POSITIONLOGHEADER, name);
+  free(block);
+
+  l->bufSize = POSITIONLOGBUFFER / sizeof(positionLogRecordType);
+  CALLOC(l->buf, l->bufSize, sizeof(positionLogRecordType));
+  return ret;
+}
+
+
+void positionLogRecord(positionLogRecordType *r, const positionType *p) {
+  memset(r, 0, sizeof(positionLogRecordType));
+  r->pos = p->pos;
+  r->submittime = p->submittime;
+  r->latency = (p->finishtime > p->submittime) ? (float)(p->finishtime - p->submittime) : 0;
+  r->len = p->len;
+  r->seed = p->seed;
+  r->action = p->action;
+  r->ramp = p->ramp;
+}
+
+
+static int positionLogFlush(positionLogType *l) {
+  const int ret = positionLogWrite(l->fd, l->buf, l->bufCount * sizeof(positionLogRecordType), l->name);
+  l->bufCount = 0;
+  return ret;
+}
+
+int positionLogAdd(positionLogType *l, const positionLogRecordType *r) {
+  if (r->action != 'F') {
+    if (l->header.minbs == 0 || r->len < l->header.minbs) l->header.minbs = r->len;
+    if (r->len > l->header.maxbs) l->header.maxbs = r->len;
+  }
+  l->buf[l->bufCount++] = *r;
+  l->count++;
+  if (l->bufCount == l->bufSize) {
+    return positionLogFlush(l);
+  }
+  return 0;
+}
+
+
+// the last records and the count in the header
+int positionLogClose(positionLogType *l) {
+  int ret = positionLogFlush(l);
+  l->header.count = l->count;
+  if (pwrite(l->fd, &l->header, sizeof(positionLogHeaderType), 0) != sizeof(positionLogHeaderType)) {
+    perror(l->name);
+    ret = 1;
+  }
+  close(l->fd);
+  free(l->buf);
+  free(l->name);
+  return ret;
+}
+
+
+// the same positions as positionContainerSave
+int positionLogSave(const positionContainer *pc, const char *name, const size_t bdSize, const size_t flushEvery, const unsigned short seed) {
+  positionLogType l;
+  if (positionLogOpen(&l, name, pc, bdSize, seed)) {
+    return 1;
+  }
+  int ret = 0;
+  positionLogRecordType r;
+  const positionType *positions = pc->positions;
+  for (size_t i = 0; i < pc->sz && ret == 0; i++) {
+    if (positions[i].success) {
+      const char action = positions[i].action;
+      if (action == 'R' || action == 'W') {
+	positionLogRecord(&r, &positions[i]);
+	ret = positionLogAdd(&l, &r);
+      }
+      if (flushEvery && ((i+1) % (flushEvery) == 0)) {
+	memset(&r, 0, sizeof(positionLogRecordType));
+	r.action = 'F';
+	r.seed = positions[i].seed;
+	ret |= positionLogAdd(&l, &r);
+      }
+    }
+  }
+  return positionLogClose(&l) | ret;
+}
+
+
+// 1 if the fd is a seekable file starting with the magic, the offset is left at 0
+int positionLogIsBinary(const int fd) {
+  char magic[8];
+  const ssize_t got = pread(fd, magic, sizeof(magic), 0);
+  return (got == sizeof(magic)) && (memcmp(magic, POSITIONLOGMAGIC, sizeof(magic)) == 0);
+}
+
+
+// checks the header at m->header and finds the records, 0 if it's a log
+static int positionLogMapCheck(positionLogMapType *m) {
+  if (m->mapLen < POSITIONLOGHEADER) {
+    fprintf(stderr,"*error* not a position log, too short\n");
+    positionLogUnmap(m);
+    return 1;
+  }
+  if (memcmp(m->header->magic, POSITIONLOGMAGIC, sizeof(m->header->magic)) != 0 || m->header->recordSize != sizeof(positionLogRecordType) || m->header->headerSize > m->mapLen) {
+    fprintf(stderr,"*error* not a version %d position log\n", POSITIONLOGVERSION);
+    positionLogUnmap(m);
+    return 1;
+  }
+  m->records = (const positionLogRecordType*)((const char*)m->header + m->header->headerSize);
+  const size_t inFile = (m->mapLen - m->header->headerSize) / sizeof(positionLogRecordType);
+  m->count = m->header->count;
+  if (m->count == 0 || m->count > inFile) {
+    if (inFile) {
+      fprintf(stderr,"*warning* the position log wasn't closed, using the %zd whole records\n", inFile);
+    }
+    m->count = inFile;
+  }
+  if (m->header->dropped) {
+    fprintf(stderr,"*warning* the I/O log dropped %zd records, the writer fell behind\n", (size_t)m->header->dropped);
+  }
+  return 0;
+}
+
+// returns 0 if mapped
+int positionLogMap(positionLogMapType *m, const int fd) {
+  memset(m, 0, sizeof(positionLogMapType));
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < POSITIONLOGHEADER) {
+    fprintf(stderr,"*error* not a position log, too short\n");
+    return 1;
+  }
+  m->mapLen = st.st_size;
+  m->map = mmap(NULL, m->mapLen, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m->map == MAP_FAILED) {
+    perror("mmap");
+    m->map = NULL;
+    return 1;
+  }
+  madvise(m->map, m->mapLen, MADV_SEQUENTIAL);
+  m->header = (const positionLogHeaderType*)m->map;
+  return positionLogMapCheck(m);
+}
+
+// a log already in memory (e.g. read from a pipe), the caller keeps the buffer
+int positionLogMapBuffer(positionLogMapType *m, const void *buf, const size_t len) {
+  memset(m, 0, sizeof(positionLogMapType));
+  m->mapLen = len;
+  m->header = (const positionLogHeaderType*)buf;
+  return positionLogMapCheck(m);
+}
+
+void positionLogUnmap(positionLogMapType *m) {
+  if (m->map) {
+    munmap(m->map, m->mapLen);
+  }
+  memset(m, 0, sizeof(positionLogMapType));
+}
+
+
+// the records as positions, like positionContainerLoad
+void positionLogLoad(positionContainer *pc, const positionLogMapType *m) {
+  positionContainerInit(pc, m->header->UUID);
+  size_t minbs = (size_t)-1, maxbs = 0;
+  positionType *p = NULL;
+  CALLOC(p, m->count ? m->count : 1, sizeof(positionType));
+  for (size_t i = 0; i < m->count; i++) {
+    const positionLogRecordType *r = &m->records[i];
+    p[i].pos = r->pos;
+    p[i].len = r->len;
+    p[i].seed = r->seed;
+    p[i].action = r->action;
+    p[i].submittime = r->submittime;
+    p[i].finishtime = r->submittime + r->latency;
+    p[i].ramp = r->ramp;
+    p[i].success = 1;
+    if (r->action != 'F') {
+      if (r->len < minbs) minbs = r->len;
+      if (r->len > maxbs) maxbs = r->len;
+    }
+  }
+  pc->positions = p;
+  pc->sz = m->count;
+  pc->string = strdup(m->header->string);
+  pc->device = strdup(m->header->device);
+  pc->bdSize = m->header->bdSize;
+  pc->minbs = m->count ? minbs : 0;
+  pc->maxbs = maxbs;
+}
+
+
+// the text format of positionContainerSave
+void positionLogExportText(FILE *fp, const positionLogMapType *m) {
+  const char *device = m->header->device;
+  const size_t bdSize = m->header->bdSize;
+  for (size_t i = 0; i < m->count; i++) {
+    const positionLogRecordType *r = &m->records[i];
+    if (r->action == 'F') {
+      fprintf(fp, "%s\t%10zd\t%.2lf GiB\t%.1lf%%\t%c\t%zd\t%zd\t%.2lf GiB\t%u\n", device, (size_t)0, 0.0, 0.0, 'F', (size_t)0, bdSize, 0.0, r->seed);
+    } else {
+      fprintf(fp, "%s\t%10zd\t%.2lf GiB\t%.1lf%%\t%c\t%u\t%zd\t%.2lf GiB\t%u\n", device, (size_t)r->pos, TOGiB(r->pos), bdSize ? r->pos * 100.0 / bdSize : 0, r->action, r->len, bdSize, TOGiB(bdSize), r->seed);
+    }
+  }
+}
+
+
+// called by the job as each I/O completes, never blocks
+void positionLogRingPush(positionLogRingType *r, const positionType *p) {
+  const size_t head = r->head;
+  if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->size) {
+    r->dropped++;
+    return;
+  }
+  positionLogRecord(&r->records[head & (r->size - 1)], p);
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void positionLogRingPushFlush(positionLogRingType *r, const double start, const double finish) {
+  positionType p;
+  memset(&p, 0, sizeof(positionType));
+  p.action = 'F';
+  p.submittime = start;
+  p.finishtime = finish;
+  positionLogRingPush(r, &p);
+}
+
+
+// move what's in the rings into the log buffers, returns the records moved
+static size_t positionLogWriterDrain(positionLogWriterType *w) {
+  size_t moved = 0;
+  for (size_t i = 0; i < w->num; i++) {
+    positionLogRingType *r = &w->rings[i];
+    const size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    size_t tail = r->tail;
+    while (tail != head) {
+      positionLogAdd(&w->logs[i], &r->records[tail & (r->size - 1)]);
+      tail++;
+      moved++;
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+  }
+  return moved;
+}
+
+static void *positionLogWriterThread(void *arg) {
+  positionLogWriterType *w = (positionLogWriterType*)arg;
+  double lastWrite = timedouble();
+  while (w->running) {
+    if (positionLogWriterDrain(w) == 0) {
+      usleep(10000);
+    }
+    // the buffers go to the file at least every second, for a crash
+    const double now = timedouble();
+    if (now - lastWrite >= 1) {
+      for (size_t i = 0; i < w->num; i++) {
+	positionLogFlush(&w->logs[i]);
+      }
+      lastWrite = now;
+    }
+  }
+  return NULL;
+}
+
+
+// open prefix-NNN.bin for each job and start the writer. Returns 0 if ok
+int positionLogWriterStart(positionLogWriterType *w, const char *prefix, positionContainer **pcs, const size_t num, const size_t *bdSizes, const unsigned short *seeds) {
+  memset(w, 0, sizeof(positionLogWriterType));
+  w->num = num;
+  CALLOC(w->rings, num, sizeof(positionLogRingType));
+  CALLOC(w->logs, num, sizeof(positionLogType));
+  char *fn;
+  CALLOC(fn, strlen(prefix) + 20, 1);
+  for (size_t i = 0; i < num; i++) {
+    sprintf(fn, "%s-%03zd.bin", prefix, i);
+    if (positionLogOpen(&w->logs[i], fn, pcs[i], bdSizes[i], seeds[i])) {
+      free(fn);
+      return 1;
+    }
+    w->rings[i].size = POSITIONLOGRING;
+    CALLOC(w->rings[i].records, POSITIONLOGRING, sizeof(positionLogRecordType));
+    pcs[i]->ioLog = &w->rings[i];
+  }
+  fprintf(stderr,"*info* streaming the I/O log to '%s-NNN.bin'\n", prefix);
+  free(fn);
+  w->running = 1;
+  pthread_create(&w->thread, NULL, positionLogWriterThread, w);
+  return 0;
+}
+
+
+// after the jobs have finished, the rest is written. Returns the records dropped
+size_t positionLogWriterStop(positionLogWriterType *w) {
+  if (w->running) {
+    w->running = 0;
+    pthread_join(w->thread, NULL);
+  }
+  positionLogWriterDrain(w);
+  size_t dropped = 0;
+  for (size_t i = 0; i < w->num; i++) {
+    w->logs[i].header.dropped = w->rings[i].dropped;
+    dropped += w->rings[i].dropped;
+    positionLogClose(&w->logs[i]);
+    free(w->rings[i].records);
+  }
+  free(w->rings);
+  free(w->logs);
+  memset(w, 0, sizeof(positionLogWriterType));
+  return dropped;
+}
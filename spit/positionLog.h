@@ -0,0 +1,108 @@
+#ifndef _POSITIONLOG_H
+#define _POSITIONLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "positions.h"
+
+/*
+ * the binary position log, spit-positions-NNN.bin. A 4 KiB header then
+ * fixed size records, native byte order, so a reader can mmap it and index
+ * the records directly. A count of 0 in the header means the writer didn't
+ * finish, the records are counted from the file size
+ */
+#define POSITIONLOGMAGIC "SPITPLOG"
+#define POSITIONLOGVERSION 1
+#define POSITIONLOGHEADER 4096
+#define POSITIONLOGBUFFER (4*1024*1024)
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t headerSize;
+  uint64_t count;         // records, 0 if not closed
+  uint64_t UUID;
+  uint64_t bdSize;
+  uint32_t minbs;
+  uint32_t maxbs;
+  uint32_t seed;          // the job's
+  uint32_t jobId;
+  uint64_t dropped;       // records a streaming log lost, the writer fell behind
+  char device[1024];
+  char string[1024];
+} positionLogHeaderType;
+
+typedef struct {
+  uint64_t pos;
+  double submittime;
+  float latency;          // seconds, 0 if not known
+  uint32_t len;
+  uint16_t seed;
+  char action;            // 'R', 'W' or 'F'
+  uint8_t ramp;           // RAMPMEASURED, RAMPWARMUP or RAMPCOOLDOWN
+  uint32_t reserved;
+} positionLogRecordType;
+
+// writing, records are buffered and written POSITIONLOGBUFFER at a time
+typedef struct {
+  int fd;
+  char *name;
+  positionLogHeaderType header;
+  positionLogRecordType *buf;
+  size_t bufCount;
+  size_t bufSize;
+  size_t count;
+} positionLogType;
+
+int  positionLogOpen(positionLogType *l, const char *name, const positionContainer *pc, const size_t bdSize, const unsigned short seed);
+void positionLogRecord(positionLogRecordType *r, const positionType *p);
+int  positionLogAdd(positionLogType *l, const positionLogRecordType *r);
+int  positionLogClose(positionLogType *l);
+int  positionLogSave(const positionContainer *pc, const char *name, const size_t bdSize, const size_t flushEvery, const unsigned short seed);
+
+/* the streaming I/O log, --iolog. Each job pushes its completions into
+ * its own single producer, single consumer ring, a writer thread drains
+ * them all into the logs. A full ring drops the record and counts it */
+#define POSITIONLOGRING (256*1024) // records per job, a power of 2
+
+typedef struct positionLogRing {
+  positionLogRecordType *records;
+  size_t size;
+  size_t head;            // the next to push, only the job writes it
+  size_t tail;            // the next to drain, only the writer writes it
+  size_t dropped;         // by the job
+} positionLogRingType;
+
+typedef struct {
+  size_t num;
+  positionLogRingType *rings;
+  positionLogType *logs;
+  volatile int running;
+  pthread_t thread;
+} positionLogWriterType;
+
+void positionLogRingPush(positionLogRingType *r, const positionType *p);
+void positionLogRingPushFlush(positionLogRingType *r, const double start, const double finish);
+int  positionLogWriterStart(positionLogWriterType *w, const char *prefix, positionContainer **pcs, const size_t num, const size_t *bdSizes, const unsigned short *seeds);
+size_t positionLogWriterStop(positionLogWriterType *w);
+
+// reading
+typedef struct {
+  void *map;
+  size_t mapLen;
+  const positionLogHeaderType *header;
+  const positionLogRecordType *records;
+  size_t count;
+} positionLogMapType;
+
+int  positionLogIsBinary(const int fd);
+int  positionLogMap(positionLogMapType *m, const int fd);
+int  positionLogMapBuffer(positionLogMapType *m, const void *buf, const size_t len);
+void positionLogUnmap(positionLogMapType *m);
+void positionLogLoad(positionContainer *pc, const positionLogMapType *m);
+void positionLogExportText(FILE *fp, const positionLogMapType *m);
+
+#endif
@@ -5,10 +5,16 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <float.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "devices.h"
 #include "utils.h"
 #include "positions.h"
+#include "positionLog.h"
 
 extern int verbose;
 extern int keepRunning;
@@ -137,6 +143,42 @@ int checkPositionArray(const positionType *positions, size_t num, size_t bdSizeB
 }
 
 
+// clear the counters of a run, keeping the positions for the next
+void positionContainerResetStats(positionContainer *pc) {
+  pc->writtenBytes = 0;
+  pc->writtenIOs = 0;
+  pc->readBytes = 0;
+  pc->readIOs = 0;
+  pc->elapsedTime = 0;
+  pc->inFlight = 0;
+  pc->errors = 0;
+  pc->allReadBytes = 0;
+  pc->allReadIOs = 0;
+  pc->allWrittenBytes = 0;
+  pc->allWrittenIOs = 0;
+  histogramInit(&pc->readLatency);
+  histogramInit(&pc->writeLatency);
+  histogramInit(&pc->flushLatency);
+  pc->cpuClockValid = 0;
+  pc->cpuClockLast = 0;
+  pc->cpuUser = 0;
+  pc->cpuSys = 0;
+  pc->ctxVoluntary = 0;
+  pc->ctxInvoluntary = 0;
+  pc->measureStart = 0;
+  memset(&pc->warmup, 0, sizeof(rampStatsType));
+  memset(&pc->cooldown, 0, sizeof(rampStatsType));
+  if (pc->positions) {
+    for (size_t i = 0; i < pc->sz; i++) {
+      pc->positions[i].success = 0;
+      pc->positions[i].ramp = RAMPMEASURED;
+      pc->positions[i].submittime = 0;
+      pc->positions[i].finishtime = 0;
+    }
+  }
+}
+
+
 // lots of checks
 void positionContainerSave(const positionContainer *p, const char *name, const size_t bdSizeBytes, const size_t flushEvery) {
   if (name) {
@@ -172,7 +214,8 @@ size_t setupPositions(positionType *positions,
 		    size_t alignment,
 		    const long startingBlock,
 		    const size_t bdSizeTotal,
-		    unsigned short seed
+		    unsigned short seed,
+		    const size_t boundary
 		    ) {
 
   assert(lowbs <= bs);
@@ -247,6 +290,13 @@ size_t setupPositions(positionType *positions,
 	// if we have gone over the end of the range
 	if (j + thislen > positionsEnd[i]) {positionsStart[i] += thislen; break;}
 
+	// a striped job's I/Os stay inside a chunk, this one starts at the next
+	if (boundary && (j / boundary) != ((j + thislen - 1) / boundary)) {
+	  positionsStart[i] = (j / boundary + 1) * boundary;
+	  nochange = 0;
+	  continue;
+	}
+
 	poss[count].pos = j;
 	poss[count].submittime = 0;
 	poss[count].finishtime = 0;
@@ -303,7 +353,7 @@ size_t setupPositions(positionType *positions,
   }
 
   if (verbose >= 2) {
-        fprintf(stderr,"*info* %zd unique positions, max %zd positions requested (-P), %.2lf GiB of device covered (%.0lf%%)\n", count, *num, TOGiB(totalLen), 100.0*TOGiB(totalLen)/TOGiB(bdSizeTotal));
+	fprintf(stderr,"*info* %zd unique positions, max %zd positions requested (-P), %.2lf GiB of device covered (%.0lf%%)\n", count, *num, TOGiB(totalLen), 100.0*TOGiB(totalLen)/TOGiB(bdSizeTotal));
   }
   
   // if randomise then reorder
@@ -347,6 +397,228 @@ size_t setupPositions(positionType *positions,
 
 
 		 
+// the text position files of positionContainerSave, read without a
+// sscanf or a realloc per line. The file is split into chunks on line
+// boundaries, the chunks' lines are counted in parallel, then each chunk
+// is parsed in parallel straight into its part of one array.
+
+#define POSITIONSTEXTCHUNK (4*1024*1024)
+#define POSITIONSTEXTTHREADS 32
+
+typedef struct {
+  const char *start, *end;  // whole lines
+  positionType *p;          // where this chunk's positions go
+  size_t lines;             // the most positions it can have
+  size_t num;               // the positions parsed
+  size_t bdSize, minbs, maxbs;
+  const char *path;         // the device of the last position
+  size_t pathLen;
+} positionsTextChunkType;
+
+// the file's contents, mmapped if it's a regular file, or read (e.g. a pipe)
+static char *positionsReadFile(FILE *fp, size_t *size, int *mapped) {
+  const int fd = fileno(fp);
+  struct stat st;
+  *mapped = 0;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      *mapped = 1;
+      *size = st.st_size;
+      return map;
+    }
+  }
+  size_t alloc = 1024*1024, got = 0;
+  char *buf = malloc(alloc);
+  assert(buf);
+  size_t r;
+  while ((r = fread(buf + got, 1, alloc - got, fp)) > 0) {
+    got += r;
+    if (got == alloc) {
+      alloc *= 2;
+      buf = realloc(buf, alloc);
+      assert(buf);
+    }
+  }
+  *size = got;
+  return buf;
+}
+
+static void positionsReleaseFile(char *buf, const size_t size, const int mapped) {
+  if (mapped) {
+    munmap(buf, size);
+  } else {
+    free(buf);
+  }
+}
+
+// the unsigned decimal in [s, e), *ok is 0 if it doesn't start with a digit
+static inline size_t positionsTextNumber(const char *s, const char *e, int *ok) {
+  size_t v = 0;
+  *ok = (s < e) && (*s >= '0') && (*s <= '9');
+  for (; s < e && *s >= '0' && *s <= '9'; s++) {
+    v = v * 10 + (*s - '0');
+  }
+  return v;
+}
+
+// device pos GiB "GiB" % action len bdSize GiB "GiB" seed, 1 if it's a position
+static int positionsTextLine(const char *s, const char *end, positionsTextChunkType *c, positionType *p) {
+  const char *f[11], *fe[11];
+  size_t n = 0;
+  while (n < 11) {
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+    if (s >= end) break;
+    f[n] = s;
+    while (s < end && *s != ' ' && *s != '\t' && *s != '\r') s++;
+    fe[n++] = s;
+  }
+  if (n < 8) {
+    return 0;
+  }
+  int okPos, okLen, okSize, okSeed = 0;
+  const size_t pos = positionsTextNumber(f[1], fe[1], &okPos);
+  const size_t len = positionsTextNumber(f[6], fe[6], &okLen);
+  const size_t bdSize = positionsTextNumber(f[7], fe[7], &okSize);
+  const size_t seed = (n > 10) ? positionsTextNumber(f[10], fe[10], &okSeed) : 0;
+  if (!okPos || !okLen || !okSize) {
+    return 0;
+  }
+  memset(p, 0, sizeof(positionType));
+  p->pos = pos;
+  p->len = len;
+  p->seed = seed;
+  p->action = *f[5];
+  p->success = 1;
+  if (p->action != 'F') {
+    if (len < c->minbs) c->minbs = len;
+    if (len > c->maxbs) c->maxbs = len;
+  }
+  if (bdSize > c->bdSize) {
+    c->bdSize = bdSize;
+  }
+  c->path = f[0];
+  c->pathLen = fe[0] - f[0];
+  return 1;
+}
+
+static void *positionsTextCount(void *arg) {
+  positionsTextChunkType *c = (positionsTextChunkType*)arg;
+  size_t lines = 0;
+  for (const char *s = c->start; s < c->end; lines++) {
+    const char *nl = memchr(s, '\n', c->end - s);
+    s = nl ? nl + 1 : c->end;
+  }
+  c->lines = lines;
+  return NULL;
+}
+
+static void *positionsTextParse(void *arg) {
+  positionsTextChunkType *c = (positionsTextChunkType*)arg;
+  c->num = 0;
+  for (const char *s = c->start; s < c->end; ) {
+    const char *nl = memchr(s, '\n', c->end - s);
+    const char *e = nl ? nl : c->end;
+    c->num += positionsTextLine(s, e, c, &c->p[c->num]);
+    s = nl ? nl + 1 : c->end;
+  }
+  return NULL;
+}
+
+// runs fn on each chunk, on its own thread if there's more than one
+static void positionsTextRun(positionsTextChunkType *chunks, const size_t n, void *(*fn)(void *)) {
+  if (n == 1) {
+    fn(&chunks[0]);
+    return;
+  }
+  pthread_t pt[POSITIONSTEXTTHREADS];
+  for (size_t i = 0; i < n; i++) {
+    pthread_create(&pt[i], NULL, fn, &chunks[i]);
+  }
+  for (size_t i = 0; i < n; i++) {
+    pthread_join(pt[i], NULL);
+  }
+}
+
+static void positionsTextLoad(positionContainer *pc, const char *buf, const size_t size) {
+  size_t n = size / POSITIONSTEXTCHUNK + 1;
+  const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus > 0 && n > (size_t)cpus) n = cpus;
+  if (n > POSITIONSTEXTTHREADS) n = POSITIONSTEXTTHREADS;
+
+  positionsTextChunkType chunks[POSITIONSTEXTTHREADS];
+  memset(chunks, 0, sizeof(chunks));
+  const char *s = buf, *end = buf + size;
+  for (size_t i = 0; i < n; i++) {
+    const char *e = (i == n - 1) ? end : buf + size * (i + 1) / n;
+    if (e < s) e = s;
+    if (e < end) {
+      const char *nl = memchr(e, '\n', end - e);
+      e = nl ? nl + 1 : end;
+    }
+    chunks[i].start = s;
+    chunks[i].end = e;
+    chunks[i].minbs = (size_t)-1;
+    s = e;
+  }
+
+  positionsTextRun(chunks, n, positionsTextCount);
+  size_t lines = 0;
+  for (size_t i = 0; i < n; i++) {
+    lines += chunks[i].lines;
+  }
+  positionType *p;
+  CALLOC(p, lines ? lines : 1, sizeof(positionType));
+  lines = 0;
+  for (size_t i = 0; i < n; i++) {
+    chunks[i].p = p + lines;
+    lines += chunks[i].lines;
+  }
+  positionsTextRun(chunks, n, positionsTextParse);
+
+  // close up the gaps left by lines that weren't positions
+  size_t num = 0, bdSize = 0, minbs = (size_t)-1, maxbs = 0;
+  const char *path = "";
+  size_t pathLen = 0;
+  for (size_t i = 0; i < n; i++) {
+    positionsTextChunkType *c = &chunks[i];
+    if (c->num == 0) continue;
+    if (c->p != p + num) {
+      memmove(p + num, c->p, c->num * sizeof(positionType));
+    }
+    num += c->num;
+    if (c->bdSize > bdSize) bdSize = c->bdSize;
+    if (c->minbs < minbs) minbs = c->minbs;
+    if (c->maxbs > maxbs) maxbs = c->maxbs;
+    path = c->path;
+    pathLen = c->pathLen;
+  }
+
+  pc->positions = p;
+  pc->sz = num;
+  pc->string = strdup("");
+  pc->device = strndup(path, pathLen);
+  pc->bdSize = bdSize;
+  pc->minbs = maxbs ? minbs : 0;
+  pc->maxbs = maxbs;
+}
+
+// a binary position log or the text format, from memory
+static void positionContainerLoadBuffer(positionContainer *pc, const char *buf, const size_t size) {
+  if (size >= 8 && memcmp(buf, POSITIONLOGMAGIC, 8) == 0) {
+    positionLogMapType m;
+    if (positionLogMapBuffer(&m, buf, size)) {
+      exit(-1);
+    }
+    positionLogLoad(pc, &m);
+    return;
+  }
+  positionContainerInit(pc, 0);
+  positionsTextLoad(pc, buf, size);
+}
+
+
 void positionStats(const positionType *positions, const size_t maxpositions, const deviceDetails *devList, const size_t devCount) {
   size_t len = 0;
   for (size_t i = 0; i < maxpositions; i++) {
@@ -362,57 +634,28 @@ void positionStats(const positionType *positions, const size_t maxpositions, con
     
   
 positionType *loadPositions(FILE *fd, size_t *num, deviceDetails **devs, size_t *numDevs, size_t *maxSize) {
-
-  char *line = malloc(200000);
-  size_t maxline = 200000;
-  ssize_t read;
-  char *path;
-  CALLOC(path, 1000, 1);
-  //  char *origline = line; // store the original pointer, as getline changes it creating an unfreeable area
-  positionType *p = NULL;
-  size_t pNum = 0;
-  
-  while ((read = getline(&line, &maxline, fd)) != -1) {
-    size_t pos, len, seed, tmpsize;
-    //    fprintf(stderr,"%zd\n", strlen(line));
-    char op;
-    
-    int s = sscanf(line, "%s %zu %*s %*s %*s %c %zu %zu %*s %*s %zu", path, &pos, &op, &len, &tmpsize, &seed);
-    if (s >= 5) {
-      //      fprintf(stderr,"%s %zd %c %zd %zd\n", path, pos, op, len, seed);
-      //      deviceDetails *d2 = addDeviceDetails(path, devs, numDevs);
-      pNum++;
-      p = realloc(p, sizeof(positionType) * (pNum));
-      assert(p);
-      //      fprintf(stderr,"%zd\n", pNum);
-      //      p[pNum-1].fd = 0;
-      p[pNum-1].pos = pos;
-      p[pNum-1].submittime = 0;
-      p[pNum-1].finishtime = 0;
-      p[pNum-1].len = len;
-      p[pNum-1].seed = seed;
-      p[pNum-1].q = 0;
-      p[pNum-1].action = op;
-      p[pNum-1].success = 0;
-      p[pNum-1].verify = 0;
-      if (tmpsize > *maxSize) {
-	*maxSize = tmpsize;
-      }
-
-      //      fprintf(stderr,"added %p\n", p[pNum-1].dev);
-      
-    //    addDeviceDetails(line, devs, numDevs);
-    //    addDeviceToAnalyse(line);
-    //    add++;
-    //    printf("%s", line);
-    }
+  size_t size;
+  int mapped;
+  char *buf = positionsReadFile(fd, &size, &mapped);
+
+  positionContainer pc;
+  positionContainerLoadBuffer(&pc, buf, size);
+  positionsReleaseFile(buf, size, mapped);
+
+  positionType *p = pc.positions;
+  for (size_t i = 0; i < pc.sz; i++) {
+    p[i].submittime = 0;
+    p[i].finishtime = 0;
+    p[i].q = 0;
+    p[i].success = 0;
+    p[i].verify = 0;
   }
-  fflush(stderr);
-
-  free(line);
-
-  free(path);
-  *num = pNum;
+  if (pc.bdSize > *maxSize) {
+    *maxSize = pc.bdSize;
+  }
+  free(pc.string);
+  free(pc.device);
+  *num = pc.sz;
   return p;
 }
 
@@ -429,6 +672,7 @@ void dumpPositions(positionType *positions, const char *prefix, const size_t num
 void positionContainerInit(positionContainer *pc, size_t UUID) {
   memset(pc, 0, sizeof(positionContainer));
   pc->UUID = UUID;
+  pc->measureUntil = DBL_MAX; // all measured unless positionRampStart says otherwise
 }
 
 void positionContainerSetup(positionContainer *pc, size_t sz, char *deviceString, char *string) {
@@ -498,6 +742,9 @@ void positionLatencyStats(positionContainer *pc, const int threadid) {
   size_t failed = 0, vslowread = 0, vslowwrite = 0;
   
   for (size_t i = 0; i < pc->sz;i++) {
+    if (pc->positions[i].ramp != RAMPMEASURED) {
+      continue;
+    }
     if (pc->positions[i].success && pc->positions[i].finishtime) {
       if (pc->positions[i].finishtime < starttime) starttime = pc->positions[i].finishtime;
       if (pc->positions[i].finishtime > finishtime) finishtime = pc->positions[i].finishtime;
@@ -526,6 +773,152 @@ void positionLatencyStats(positionContainer *pc, const int threadid) {
   }
 }
   
+
+/* warm-up and cool-down. Each I/O is tagged when it's submitted and its
+ * completion goes to that window's stats. The counters are incremented for
+ * every I/O as they drive the live view, positionRampFinish takes the
+ * ramps off at the end. The last cooldownCount measured completions are
+ * held in a ring so they can be moved to the cool-down */
+void positionRampStart(positionContainer *pc, const double start, const double finish) {
+  pc->measureFrom = pc->warmupCount ? DBL_MAX : start + pc->warmupTime;
+  pc->measureUntil = pc->cooldownTime ? finish - pc->cooldownTime : DBL_MAX;
+  pc->measureStart = 0;
+  pc->ringHead = 0;
+  pc->ringCount = 0;
+  if (pc->cooldownCount && !pc->cooldownRing) {
+    CALLOC(pc->cooldownRing, pc->cooldownCount, sizeof(rampRecordType));
+  }
+}
+
+
+static void rampAdd(rampStatsType *r, const char action, const size_t len) {
+  if (action == 'R') {
+    r->readBytes += len;
+    r->readIOs++;
+  } else {
+    r->writtenBytes += len;
+    r->writtenIOs++;
+  }
+}
+
+
+// returns the ramp of an I/O being submitted now
+int positionRampSubmit(positionContainer *pc, const positionType *p, const double now) {
+  if (now < pc->measureFrom) {
+    rampAdd(&pc->warmup, p->action, p->len);
+    if (pc->warmupCount && pc->warmup.readIOs + pc->warmup.writtenIOs >= pc->warmupCount) {
+      pc->measureFrom = now; // that was the last
+    }
+    return RAMPWARMUP;
+  }
+  if (now >= pc->measureUntil) {
+    rampAdd(&pc->cooldown, p->action, p->len);
+    return RAMPCOOLDOWN;
+  }
+  if (pc->measureStart == 0) {
+    pc->measureStart = now;
+  }
+  return RAMPMEASURED;
+}
+
+
+void positionRampComplete(positionContainer *pc, const positionType *p) {
+  const double latency = p->finishtime - p->submittime;
+  if (p->ramp == RAMPWARMUP) {
+    histogramAdd((p->action == 'R') ? &pc->warmup.readLatency : &pc->warmup.writeLatency, latency);
+  } else if (p->ramp == RAMPCOOLDOWN) {
+    histogramAdd((p->action == 'R') ? &pc->cooldown.readLatency : &pc->cooldown.writeLatency, latency);
+  } else if (pc->cooldownRing) {
+    rampRecordType *r;
+    if (pc->ringCount == pc->cooldownCount) { // full, the oldest is measured after all
+      r = &pc->cooldownRing[pc->ringHead];
+      histogramAdd((r->action == 'R') ? &pc->readLatency : &pc->writeLatency, r->latency);
+      pc->ringHead = (pc->ringHead + 1) % pc->cooldownCount;
+      pc->ringCount--;
+    }
+    r = &pc->cooldownRing[(pc->ringHead + pc->ringCount) % pc->cooldownCount];
+    r->submittime = p->submittime;
+    r->latency = latency;
+    r->len = p->len;
+    r->action = p->action;
+    r->index = (pc->positions && p >= pc->positions && p < pc->positions + pc->sz) ? (size_t)(p - pc->positions) : (size_t)-1;
+    pc->ringCount++;
+  } else {
+    histogramAdd((p->action == 'R') ? &pc->readLatency : &pc->writeLatency, latency);
+  }
+}
+
+
+// take the ramps out of the counters and set elapsedTime to the measured window
+void positionRampFinish(positionContainer *pc, const double start, const double finish) {
+  double until = pc->cooldownTime ? MIN(pc->measureUntil, finish) : finish;
+
+  if (pc->ringCount) {
+    until = pc->cooldownRing[pc->ringHead].submittime;
+    for (size_t i = 0; i < pc->ringCount; i++) {
+      const rampRecordType *r = &pc->cooldownRing[(pc->ringHead + i) % pc->cooldownCount];
+      rampAdd(&pc->cooldown, r->action, r->len);
+      histogramAdd((r->action == 'R') ? &pc->cooldown.readLatency : &pc->cooldown.writeLatency, r->latency);
+      if (pc->positions && r->index < pc->sz) {
+	pc->positions[r->index].ramp = RAMPCOOLDOWN; // so the per-job summary leaves it out too
+      }
+    }
+  }
+  free(pc->cooldownRing);
+  pc->cooldownRing = NULL;
+  pc->ringCount = 0;
+
+  // they were counted as measured when submitted
+  pc->readBytes -= MIN(pc->readBytes, pc->warmup.readBytes + pc->cooldown.readBytes);
+  pc->readIOs -= MIN(pc->readIOs, pc->warmup.readIOs + pc->cooldown.readIOs);
+  pc->writtenBytes -= MIN(pc->writtenBytes, pc->warmup.writtenBytes + pc->cooldown.writtenBytes);
+  pc->writtenIOs -= MIN(pc->writtenIOs, pc->warmup.writtenIOs + pc->cooldown.writtenIOs);
+
+  const double from = ((pc->warmupTime > 0 || pc->warmupCount) && pc->measureStart > 0) ? pc->measureStart : start;
+  if (until < from) until = from;
+  pc->warmup.seconds = from - start;
+  pc->cooldown.seconds = finish - until;
+  pc->elapsedTime = until - from;
+}
+
+
+static void rampStatsPrint(const rampStatsType *r, const char *name, const positionContainer *pc, const int threadid) {
+  const double e = (r->seconds > 0) ? r->seconds : 1;
+  fprintf(stderr,"*info* [T%d] '%s': %s %.1lf s: R %.0lf MiB/s (%.0lf IO/s), W %.0lf MiB/s (%.0lf IO/s), mean latency R %.0lf us, W %.0lf us, %zd IOs\n", threadid, pc->string, name, r->seconds, TOMiB(r->readBytes) / e, r->readIOs / e, TOMiB(r->writtenBytes) / e, r->writtenIOs / e, histogramMean(&r->readLatency) * 1000000, histogramMean(&r->writeLatency) * 1000000, r->readIOs + r->writtenIOs);
+}
+
+void positionRampStats(const positionContainer *pc, const int threadid) {
+  if (pc->warmupTime > 0 || pc->warmupCount) {
+    rampStatsPrint(&pc->warmup, "warm-up", pc, threadid);
+  }
+  if (pc->cooldownTime > 0 || pc->cooldownCount) {
+    rampStatsPrint(&pc->cooldown, "cool-down", pc, threadid);
+  }
+}
+
+
+// check a block read back from a written position: 0 ok, 1 wrong stored position, 2 wrong contents
+int positionVerifyBlock(const positionType *p, const char *block, const char *expected) {
+  size_t stored;
+  memcpy(&stored, block, sizeof(size_t));
+  if (stored != p->pos) {
+    return 1;
+  }
+  // the first 16 bytes are the position and UUID watermark
+  if (strncmp(block + 16, expected + 16, p->len - 16) != 0) {
+    return 2;
+  }
+  return 0;
+}
+
+// the CPU cost of the I/O
+void positionCPUStats(const positionContainer *pc, const int threadid) {
+  const size_t ios = pc->readIOs + pc->writtenIOs;
+  const double MiB = TOMiB(pc->readBytes + pc->writtenBytes);
+  const double cpu = pc->cpuUser + pc->cpuSys;
+  fprintf(stderr,"*info* [T%d] '%s': CPU user %.3lf s, sys %.3lf s (%.0lf%%), %.2lf us/IO, %.1lf us/MiB, ctx switches %zd voluntary, %zd involuntary\n", threadid, pc->string, pc->cpuUser, pc->cpuSys, (pc->elapsedTime > 0) ? 100.0 * cpu / pc->elapsedTime : 0, ios ? cpu * 1000000.0 / ios : 0, (MiB > 0) ? cpu * 1000000.0 / MiB : 0, pc->ctxVoluntary, pc->ctxInvoluntary);
+}
+  
 size_t setupRandomPositions(positionType *pos,
 			  const size_t num,
 			  const double rw,
@@ -533,7 +926,8 @@ size_t setupRandomPositions(positionType *pos,
 			  const size_t highbs,
 			  const size_t alignment,
 			  const size_t bdSize,
-			  const size_t seedin) {
+			  const size_t seedin,
+			  const size_t boundary) {
   unsigned int seed = seedin;
   const int alignbits = (int)(log(alignment)/log(2) + 0.01);
   const int bdSizeBits = (bdSize-highbs) >> alignbits;
@@ -551,6 +945,9 @@ size_t setupRandomPositions(positionType *pos,
     randVal = (randVal << 31) | low;
 
     size_t randPos = (randVal % bdSizeBits) << alignbits;
+    if (boundary && (randPos / boundary) != ((randPos + thislen - 1) / boundary)) {
+      randPos = (randPos / boundary) * boundary; // a striped job's I/Os stay inside a chunk
+    }
 
     assert (randPos + thislen <= bdSize);
     pos[i].pos = randPos;
@@ -576,63 +973,11 @@ size_t setupRandomPositions(positionType *pos,
 
 
 void positionContainerLoad(positionContainer *pc, FILE *fd) {
-
-  positionContainerInit(pc, 0);
-  
-  char *line = malloc(200000);
-  size_t maxline = 200000, maxSize = 0, minbs = (size_t)-1, maxbs = 0;
-  ssize_t read;
-  char *path;
-  CALLOC(path, 1000, 1);
-  //  char *origline = line; // store the original pointer, as getline changes it creating an unfreeable area
-  positionType *p = NULL;
-  size_t pNum = 0;
-
-  while ((read = getline(&line, &maxline, fd)) != -1) {
-    size_t pos, len, seed, tmpsize;
-    //    fprintf(stderr,"%zd\n", strlen(line));
-    char op;
-    
-    int s = sscanf(line, "%s %zu %*s %*s %*s %c %zu %zu %*s %*s %zu", path, &pos, &op, &len, &tmpsize, &seed);
-    if (s >= 5) {
-      //      fprintf(stderr,"%s %zd %c %zd %zd\n", path, pos, op, len, seed);
-      //      deviceDetails *d2 = addDeviceDetails(path, devs, numDevs);
-      pNum++;
-      p = realloc(p, sizeof(positionType) * (pNum));
-      assert(p);
-      //      fprintf(stderr,"%zd\n", pNum);
-      //      p[pNum-1].fd = 0;
-      p[pNum-1].pos = pos;
-      p[pNum-1].len = len;
-      if (len < minbs) minbs = len;
-      if (len > maxbs) maxbs = len;
-      p[pNum-1].action = op;
-      p[pNum-1].success = 1;
-      p[pNum-1].seed = seed;
-      if (tmpsize > maxSize) {
-	maxSize = tmpsize;
-      }
-
-      //      fprintf(stderr,"added %p\n", p[pNum-1].dev);
-      
-    //    addDeviceDetails(line, devs, numDevs);
-    //    addDeviceToAnalyse(line);
-    //    add++;
-    //    printf("%s", line);
-    }
-  }
-  fflush(stderr);
-
-  free(line);
-
-  pc->positions = p;
-  pc->sz = pNum;
-  pc->string = strdup("");
-  pc->device = path;
-  pc->bdSize = maxSize;
-  pc->minbs = minbs;
-  pc->maxbs = maxbs;
-
+  size_t size;
+  int mapped;
+  char *buf = positionsReadFile(fd, &size, &mapped);
+  positionContainerLoadBuffer(pc, buf, size);
+  positionsReleaseFile(buf, size, mapped);
   fclose(fd);
 }
 
@@ -2,8 +2,11 @@
 #define _POSITIONS_H
 
 #include <stdio.h>
+#include <time.h>
 
 #include "devices.h"
+#include "histogram.h"
+#include "stripe.h"
 
 typedef struct {
   size_t pos;                    // 8
@@ -14,8 +17,42 @@ typedef struct {
   char  action;                  // 1: 'R' or 'W'
   unsigned int  success:4;               // 0.5
   unsigned int  verify:4;                // 0.5
+  unsigned int  ramp:2;                  // RAMPMEASURED, RAMPWARMUP or RAMPCOOLDOWN
 } positionType;
 
+#define RAMPMEASURED 0
+#define RAMPWARMUP 1
+#define RAMPCOOLDOWN 2
+
+// the I/O of a warm-up or cool-down window, not in the measured stats
+typedef struct {
+  double seconds;
+  size_t readBytes;
+  size_t readIOs;
+  size_t writtenBytes;
+  size_t writtenIOs;
+  histogramType readLatency;
+  histogramType writeLatency;
+} rampStatsType;
+
+// a measured I/O held back in case it's one of the last cooldownCount
+typedef struct {
+  double submittime;
+  double latency;
+  unsigned int len;
+  char action;
+  size_t index;           // in positions, to retag it, (size_t)-1 if it isn't there
+} rampRecordType;
+
+// changes from the control socket, the job applies them at its next submission
+typedef struct {
+  volatile int paused;
+  volatile int stop;
+  volatile size_t queueDepth; // 0 for the job's, at most the job's
+  volatile double rate;       // IOPS, 0 for no limit
+  size_t maxQueueDepth;       // the job's, set by the job
+} jobControlType;
+
 typedef struct {
   positionType *positions;
   size_t sz;
@@ -29,7 +66,39 @@ typedef struct {
   size_t readBytes;
   size_t readIOs;
   size_t UUID;
+  size_t jobId;           // for the probes
+  stripeType *stripe;     // the devices if striped, NULL if not
   double elapsedTime;
+  size_t inFlight;
+  size_t errors;          // failed I/Os
+  size_t allReadBytes;    // the ramps too, only go up for the metrics counters
+  size_t allReadIOs;
+  size_t allWrittenBytes;
+  size_t allWrittenIOs;
+  histogramType readLatency;
+  histogramType writeLatency;
+  histogramType flushLatency;
+  clockid_t cpuClock;     // the job thread's CPU clock, for the timer
+  int cpuClockValid;
+  double cpuClockLast;    // the clock when the thread finished, the timer uses it after
+  double cpuUser;         // CPU seconds while doing I/O
+  double cpuSys;
+  size_t ctxVoluntary;    // context switches while doing I/O
+  size_t ctxInvoluntary;
+  double warmupTime;      // seconds at the start that aren't measured
+  size_t warmupCount;     // or the first I/Os
+  double cooldownTime;    // seconds at the end that aren't measured
+  size_t cooldownCount;   // or the last I/Os
+  double measureFrom;     // I/Os submitted before are warm-up
+  double measureUntil;    // and after are cool-down
+  double measureStart;    // the first measured submission
+  rampStatsType warmup;
+  rampStatsType cooldown;
+  rampRecordType *cooldownRing;
+  size_t ringHead;
+  size_t ringCount;
+  jobControlType control;
+  struct positionLogRing *ioLog; // --iolog, NULL if not streaming
 } positionContainer;
 
 positionType *createPositions(size_t num);
@@ -50,7 +119,8 @@ size_t setupPositions(positionType *positions,
 		    size_t alignment,
 		    const long startingBlock,
 		    const size_t bdSizeTotal,
-		    unsigned short seed
+		    unsigned short seed,
+		    const size_t boundary  // no position crosses a multiple of it, 0 for none
 		    );
 
 void freePositions(positionType *p);
@@ -61,14 +131,22 @@ void dumpPositions(positionType *positions, const char *prefix, const size_t num
 void positionContainerInit(positionContainer *pc, size_t UUID);
 void positionContainerSetup(positionContainer *pc, size_t sz, char *device, char *string);
 void positionContainerFree(positionContainer *pc);
+void positionContainerResetStats(positionContainer *pc);
+void positionRampStart(positionContainer *pc, const double start, const double finish);
+int  positionRampSubmit(positionContainer *pc, const positionType *p, const double now);
+void positionRampComplete(positionContainer *pc, const positionType *p);
+void positionRampFinish(positionContainer *pc, const double start, const double finish);
+void positionRampStats(const positionContainer *pc, const int threadid);
 
 void positionContainerLoad(positionContainer *pc, FILE *fp);
 
 void positionContainerInfo(const positionContainer *pc);
 
 void positionLatencyStats(positionContainer *pc, const int threadid);
+void positionCPUStats(const positionContainer *pc, const int threadid);
 
 void positionContainerAddMetadataChecks(positionContainer *pc);
+int  positionVerifyBlock(const positionType *p, const char *block, const char *expected);
 
 size_t setupRandomPositions(positionType *pos,
 			  const size_t num,
@@ -77,7 +155,8 @@ size_t setupRandomPositions(positionType *pos,
 			  const size_t highbs,
 			  const size_t alignment,
 			  const size_t bdSize,
-			  const size_t seedin);
+			  const size_t seedin,
+			  const size_t boundary);
 
 size_t numberOfDuplicates(positionType *pos, size_t const num);
 
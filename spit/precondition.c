@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <libaio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "precondition.h"
+#include "ioEngine.h"
+#include "utils.h"
+
+/**
+ * precondition.c
+ *
+ * sequential passes over the whole device, split into streams so a high QD
+ * keeps many regions busy, then optional random 4 KiB overwrites. Run on the
+ * test jobs' open fds straight before the test
+ *
+ */
+
+extern volatile int keepRunning;
+
+#define PRECONDITIONRANDOMBS 4096
+
+void preconditionInit(preconditionType *p) {
+  p->name = "precondition";
+  p->seqPasses = 0;
+  p->randomPasses = 0;
+  p->blockSize = 1024 * 1024;
+  p->queueDepth = 32;
+  p->streams = 8;
+}
+
+
+// "2" or "2,1" passes, then optional ":k1024q32s8"
+int preconditionParse(preconditionType *p, const char *spec) {
+  preconditionInit(p);
+  char *endp = NULL;
+  p->seqPasses = strtoul(spec, &endp, 10);
+  if (*endp == ',') {
+    p->randomPasses = strtoul(endp + 1, &endp, 10);
+  }
+  if (*endp == ':') {
+    for (const char *c = endp + 1; *c; c++) {
+      if (*c == 'k') p->blockSize = 1024 * atoi(c + 1);
+      if (*c == 'q') p->queueDepth = atoi(c + 1);
+      if (*c == 's') p->streams = atoi(c + 1);
+    }
+  } else if (*endp) {
+    p->seqPasses = 0;
+  }
+
+  if ((p->seqPasses == 0 && p->randomPasses == 0) || p->blockSize < PRECONDITIONRANDOMBS || p->queueDepth < 1 || p->streams < 1) {
+    fprintf(stderr,"*error* can't parse --precondition '%s', e.g. 2 or 2,1 or 2,1:k1024q32s8\n", spec);
+    return 1;
+  }
+  p->blockSize -= p->blockSize % PRECONDITIONRANDOMBS;
+  return 0;
+}
+
+
+int preconditionEnabled(const preconditionType *p) {
+  return p->seqPasses || p->randomPasses;
+}
+
+
+static size_t xorshift(size_t *state) {
+  size_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+
+static void preconditionProgress(const char *name, const char *phase, const size_t pass, const size_t passes, const size_t done, const size_t total, const double start) {
+  const double elapsed = timedouble() - start;
+  const double rate = (elapsed > 0) ? done / elapsed : 0;
+  const size_t eta = (rate > 0) ? (size_t)((total - done) / rate) : 0;
+  fprintf(stderr,"*info* %s %s pass %zd/%zd: %5.1lf%%, %.0lf MiB/s, ETA %zd:%02zd:%02zd\n", name, phase, pass, passes, 100.0 * done / total, TOMiB(rate), eta / 3600, (eta / 60) % 60, eta % 60);
+}
+
+
+/* one pass, sequential streams if random is 0. Returns the bytes written or
+ * 0 on an I/O error */
+static size_t preconditionPass(const preconditionType *p, ioEngineType *e, const int fd, const size_t bdSize, char *buffers,
+			       struct iocb **cbs, struct io_event *events, const int random, const size_t pass, const size_t passes) {
+  const size_t bs = random ? PRECONDITIONRANDOMBS : p->blockSize;
+  const size_t QD = p->queueDepth;
+  const size_t streams = random ? 1 : MIN(p->streams, MAX(bdSize / bs, 1));
+  const size_t region = (bdSize / streams) - ((bdSize / streams) % PRECONDITIONRANDOMBS);
+  const size_t blocks = bdSize / PRECONDITIONRANDOMBS;
+
+  size_t *next, *end, *freeSlots;
+  CALLOC(next, streams, sizeof(size_t));
+  CALLOC(end, streams, sizeof(size_t));
+  CALLOC(freeSlots, QD, sizeof(size_t));
+  for (size_t s = 0; s < streams; s++) {
+    next[s] = s * region;
+    end[s] = (s == streams - 1) ? bdSize - (bdSize % PRECONDITIONRANDOMBS) : (s + 1) * region;
+  }
+  for (size_t q = 0; q < QD; q++) {
+    freeSlots[q] = q;
+  }
+
+  const size_t total = random ? blocks * PRECONDITIONRANDOMBS : end[streams - 1];
+  size_t submitted = 0, written = 0, inFlight = 0, numFree = QD, stream = 0, seed = 0x9E3779B97F4A7C15UL ^ (pass + 1);
+  int failed = 0;
+  const double start = timedouble();
+  double lastProgress = start;
+
+  while (inFlight || (keepRunning && !failed && submitted < total)) {
+    while (keepRunning && !failed && numFree && submitted < total) {
+      size_t offset, len;
+      if (random) {
+	offset = (xorshift(&seed) % blocks) * PRECONDITIONRANDOMBS;
+	len = PRECONDITIONRANDOMBS;
+      } else {
+	while (next[stream] >= end[stream]) stream = (stream + 1) % streams; // some are left as submitted < total
+	offset = next[stream];
+	len = MIN(bs, end[stream] - offset);
+	next[stream] += len;
+	stream = (stream + 1) % streams;
+      }
+      const size_t slot = freeSlots[--numFree];
+      io_prep_pwrite(cbs[slot], fd, buffers + slot * p->blockSize, len, offset);
+      cbs[slot]->data = (void*)slot;
+      if (ioEngineSubmit(e, cbs[slot]) != 1) {
+	perror("precondition submit");
+	freeSlots[numFree++] = slot;
+	failed = 1;
+      }
+      if (!failed) {
+	inFlight++;
+	submitted += len;
+      }
+    }
+    if (!inFlight) break;
+
+    const int ret = ioEngineGetEvents(e, 1, QD, events, NULL);
+    for (int j = 0; j < ret; j++) {
+      if ((long)events[j].res < 0 || events[j].res2 != 0) {
+	if (!failed) fprintf(stderr,"*error* %s write failed: %s\n", p->name, strerror(-(int)events[j].res));
+	failed = 1;
+      }
+      written += events[j].obj->u.c.nbytes;
+      freeSlots[numFree++] = (size_t)events[j].obj->data;
+    }
+    inFlight -= ret;
+
+    const double now = timedouble();
+    if (now - lastProgress >= 1) {
+      preconditionProgress(p->name, random ? "random" : "sequential", pass, passes, written, total, start);
+      lastProgress = now;
+    }
+  }
+  free(next);
+  free(end);
+  free(freeSlots);
+
+  return failed ? 0 : written;
+}
+
+
+// returns the seconds taken, or -1 on an error
+double preconditionDevice(const preconditionType *p, const char *device, const int fd, const int engine, const size_t bdSize, size_t *bytes) {
+  *bytes = 0;
+  if (engine == IOENGINENULL) {
+    fprintf(stderr,"*info* %s skipped, the %s engine doesn't use '%s'\n", p->name, ioEngineName(engine), device);
+    return 0;
+  }
+  const double start = timedouble();
+  fprintf(stderr,"*info* %s '%s' (%.3lf GiB): %zd sequential pass(es) of %zd KiB x QD %zd over %zd streams, %zd random pass(es) of %d KiB\n",
+	  p->name, device, TOGiB(bdSize), p->seqPasses, p->blockSize / 1024, p->queueDepth, p->streams, p->randomPasses, PRECONDITIONRANDOMBS / 1024);
+
+  ioEngineType e;
+  if (ioEngineSetup(&e, engine, p->queueDepth, device, bdSize)) {
+    fprintf(stderr,"*error* %s io_setup failed with %zd\n", p->name, p->queueDepth);
+    return -1;
+  }
+  char *buffers;
+  CALLOC(buffers, p->queueDepth, p->blockSize);
+  generateRandomBuffer(buffers, p->queueDepth * p->blockSize, (unsigned short)start); // not zeros, they might compress
+  struct iocb **cbs;
+  struct io_event *events;
+  CALLOC(cbs, p->queueDepth, sizeof(struct iocb*));
+  CALLOC(events, p->queueDepth, sizeof(struct io_event));
+  for (size_t q = 0; q < p->queueDepth; q++) {
+    CALLOC(cbs[q], 1, sizeof(struct iocb));
+  }
+
+  int failed = 0;
+  const size_t passes = p->seqPasses + p->randomPasses;
+  for (size_t pass = 0; pass < passes && keepRunning && !failed; pass++) {
+    const int random = (pass >= p->seqPasses);
+    const size_t written = preconditionPass(p, &e, fd, bdSize, buffers, cbs, events, random, random ? pass - p->seqPasses + 1 : pass + 1, random ? p->randomPasses : p->seqPasses);
+    if (written == 0) failed = 1;
+    *bytes += written;
+  }
+  ioEngineFlush(&e, fd);
+
+  for (size_t q = 0; q < p->queueDepth; q++) {
+    free(cbs[q]);
+  }
+  free(cbs);
+  free(events);
+  free(buffers);
+  ioEngineDestroy(&e);
+
+  const double elapsed = timedouble() - start;
+  if (failed) {
+    fprintf(stderr,"*error* %s of '%s' failed\n", p->name, device);
+    return -1;
+  }
+  if (!keepRunning) {
+    fprintf(stderr,"*warning* %s of '%s' interrupted\n", p->name, device);
+  }
+  fprintf(stderr,"*info* %s '%s' wrote %.1lf GiB in %.1lf s (%.0lf MiB/s)\n", p->name, device, TOGiB(*bytes), elapsed, elapsed > 0 ? TOMiB(*bytes) / elapsed : 0);
+  return elapsed;
+}
+
+
+// a new file, one pass of random data at a high QD so reads don't hit unwritten extents
+int preconditionFillFile(const char *filename, const size_t size) {
+  int fd = open(filename, O_RDWR | O_DIRECT);
+  if (fd < 0) {
+    fd = open(filename, O_RDWR);
+  }
+  if (fd < 0) {
+    perror(filename); return 1;
+  }
+  preconditionType fill;
+  preconditionInit(&fill);
+  fill.name = "fill";
+  fill.seqPasses = 1;
+  size_t bytes = 0;
+  const double t = preconditionDevice(&fill, filename, fd, IOENGINEAIO, size, &bytes);
+  fsync(fd);
+  close(fd);
+  return (t < 0);
+}
+
+
+void preconditionJSON(FILE *fp, const preconditionType *p, const double seconds, const size_t bytes) {
+  fprintf(fp, "{\"seqPasses\": %zd, \"randomPasses\": %zd, \"blockSize\": %zd, \"queueDepth\": %zd, \"streams\": %zd, \"seconds\": %.3lf, \"bytes\": %zd, \"MiBs\": %.2lf}",
+	  p->seqPasses, p->randomPasses, p->blockSize, p->queueDepth, p->streams, seconds, bytes, seconds > 0 ? TOMiB(bytes) / seconds : 0);
+}
@@ -0,0 +1,23 @@
+#ifndef _PRECONDITION_H
+#define _PRECONDITION_H
+
+#include <stdio.h>
+
+// fill the device before the test, e.g. --precondition 2,1:k1024q32s8
+typedef struct {
+  const char *name;       // for the messages
+  size_t seqPasses;       // sequential writes of the whole device
+  size_t randomPasses;    // then random 4 KiB overwrites of the device size
+  size_t blockSize;       // of the sequential writes
+  size_t queueDepth;
+  size_t streams;         // the device is split in this many sequential regions
+} preconditionType;
+
+void   preconditionInit(preconditionType *p);
+int    preconditionParse(preconditionType *p, const char *spec);
+int    preconditionEnabled(const preconditionType *p);
+double preconditionDevice(const preconditionType *p, const char *device, const int fd, const int engine, const size_t bdSize, size_t *bytes);
+int    preconditionFillFile(const char *filename, const size_t size);
+void   preconditionJSON(FILE *fp, const preconditionType *p, const double seconds, const size_t bytes);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _PROBES_H
+#define _PROBES_H
+
+/**
+ * probes.h
+ *
+ * USDT (SDT note) probes in the I/O hot path, for bpftrace/perf to line up
+ * spit's I/Os with the block layer. Build with -DSPIT_USDT=ON (needs
+ * sys/sdt.h from systemtap-sdt-dev), otherwise they compile to nothing.
+ *
+ * e.g. bpftrace -e 'usdt:./spit:spit:submit { @[arg3] = count(); }'
+ *
+ * submit, complete, flush_start, flush_end: job, offset, len, action, slot
+ * error: job, offset, len, action, slot, res
+ */
+
+#ifdef SPIT_USDT
+#include <sys/sdt.h>
+#define SPITPROBE(name, job, offset, len, action, slot) DTRACE_PROBE5(spit, name, job, offset, len, action, slot)
+#define SPITPROBEERROR(job, pp, res) DTRACE_PROBE6(spit, error, job, (pp)->pos, (pp)->len, (pp)->action, (pp)->q, res)
+#else
+#define SPITPROBE(name, job, offset, len, action, slot) do {} while (0)
+#define SPITPROBEERROR(job, pp, res) do {} while (0)
+#endif
+
+#endif
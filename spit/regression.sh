@@ -0,0 +1,223 @@
+#!/bin/bash
+#
+# regression.sh
+#
+# runs a fixed matrix of spit workloads several times, then compares the
+# mean of each metric with a stored baseline. A metric regresses if it's
+# worse by more than the threshold and Welch's t-test says the difference
+# is significant at 95%. Exit code 1 on any regression.
+#
+#   ./regression.sh -s ./spit -B baseline.json          # compare (records if missing)
+#   ./regression.sh -s ./spit -B baseline.json -b       # record a new baseline
+#   ./regression.sh -s ./spit -f /dev/loop0             # use a loop device
+#
+
+spit=./spit
+baseline=spit-regression-baseline.json
+target=/dev/shm/spit-regression.img
+record=0
+reps=5
+duration=3
+threshold=5
+
+usage() {
+    echo "Usage: regression.sh [-s spit] [-B baseline.json] [-b] [-f file|device] [-n reps] [-t secs] [-p percent]"
+    echo "  -b   record the baseline instead of comparing"
+    echo "  -f   the target, a file (tmpfs by default) or a loop device (default $target)"
+    echo "  -n   runs of each workload (default $reps)"
+    echo "  -t   seconds per run (default $duration)"
+    echo "  -p   the change in percent that is worth failing for (default $threshold)"
+    exit 1
+}
+
+while getopts "s:B:bf:n:t:p:" opt
+do
+    case $opt in
+	s) spit=$(readlink -f $OPTARG) ;;
+	B) baseline=$(readlink -f $OPTARG) ;;
+	b) record=1 ;;
+	f) target=$OPTARG ;;
+	n) reps=$OPTARG ;;
+	t) duration=$OPTARG ;;
+	p) threshold=$OPTARG ;;
+	*) usage ;;
+    esac
+done
+
+if [ ! -x "$spit" ]
+then
+    echo "*error* can't run '$spit'"
+    exit 1
+fi
+if [ $reps -lt 2 ]
+then
+    echo "*error* need at least 2 runs for the confidence intervals"
+    exit 1
+fi
+
+# tmpfs files can't do O_DIRECT, block devices can
+direct=""
+if [ ! -b "$target" ]
+then
+    direct="D"
+    # made here as spit won't create files under /dev
+    if [ ! -f "$target" ]
+    then
+	truncate -s 256M "$target" || exit 1
+	made=$target
+    fi
+fi
+
+# name, job string. The null engine measures spit's own overhead
+workloads=(
+    "null-randread-4k:rs0k4q64N"
+    "null-randwrite-4k:ws0k4q64N"
+    "null-mixed-64k:rws0k64q32N"
+    "randread-4k:rs0k4q32$direct"
+    "randwrite-4k:ws0k4q32$direct"
+    "seqread-128k:rs1k128q8$direct"
+    "seqwrite-128k:ws1k128q8$direct"
+)
+
+# lower is better for latency and CPU, higher for throughput
+metrics="IOPS MiBs p50us p99us cpuusPerIO"
+
+workdir=$(mktemp -d /tmp/spit-regression-XXXXXX)
+trap "rm -rf $workdir $made" EXIT
+cd $workdir
+
+# the metrics of one run from the -J results
+extract() {
+    awk '
+    function value(line, key,   m) {
+	if (match(line, "\"" key "\": [-0-9.e+]+")) {
+	    m = substr(line, RSTART, RLENGTH); sub(/.*: /, "", m); return m + 0
+	}
+	return 0
+    }
+    /"aggregate"/ { agg = 1 }
+    agg && /"throughput"/ { iops = value($0, "readIOPS") + value($0, "writeIOPS"); mibs = value($0, "readMiBs") + value($0, "writeMiBs") }
+    agg && /"readLatency"/ { rc = value($0, "count"); r50 = value($0, "p50"); r99 = value($0, "p99") }
+    agg && /"writeLatency"/ { wc = value($0, "count"); w50 = value($0, "p50"); w99 = value($0, "p99") }
+    agg && /"cpu"/ { cpu = value($0, "usPerIO") }
+    END {
+	# the latency of the direction with the most I/Os
+	p50 = (rc >= wc) ? r50 : w50; p99 = (rc >= wc) ? r99 : w99
+	printf "%s %s %.1f %.1f %s\n", iops, mibs, p50 * 1000000, p99 * 1000000, cpu
+    }' $1
+}
+
+echo "*info* spit regression: ${#workloads[@]} workloads x $reps runs x ${duration}s on $target"
+
+: > samples.txt
+for w in "${workloads[@]}"
+do
+    name=${w%%:*}
+    job=${w#*:}
+    for r in $(seq 1 $reps)
+    do
+	if ! $spit -f $target -G 0.25 -t $duration -c $job -J run.json > run.log 2>&1
+	then
+	    echo "*error* '$spit -f $target -c $job' failed, see below"
+	    tail -20 run.log
+	    exit 1
+	fi
+	echo "$name $(extract run.json)" >> samples.txt
+    done
+    echo "*info* $name: $(grep "^$name " samples.txt | awk '{s += $2} END {printf "%.0f IOPS mean", s / NR}')"
+done
+
+# mean, standard deviation and n of each metric, one JSON object per line
+summarise() {
+    awk -v metrics="$metrics" -v duration=$duration -v target="$target" '
+    BEGIN { nm = split(metrics, names, " ") }
+    {
+	if (!($1 in n)) order[++nw] = $1
+	n[$1]++
+	for (m = 1; m <= nm; m++) { v = $(m + 1); s[$1, m] += v; ss[$1, m] += v * v }
+    }
+    END {
+	printf "{\n  \"duration\": %s,\n  \"target\": \"%s\",\n  \"workloads\": [\n", duration, target
+	for (w = 1; w <= nw; w++) {
+	    k = order[w]
+	    printf "    {\"name\": \"%s\", \"n\": %d", k, n[k]
+	    for (m = 1; m <= nm; m++) {
+		mean = s[k, m] / n[k]
+		var = (n[k] > 1) ? (ss[k, m] - n[k] * mean * mean) / (n[k] - 1) : 0
+		if (var < 0) var = 0
+		printf ", \"%s\": {\"mean\": %.4f, \"sd\": %.4f}", names[m], mean, sqrt(var)
+	    }
+	    printf "}%s\n", (w < nw) ? "," : ""
+	}
+	printf "  ]\n}\n"
+    }' samples.txt
+}
+
+summarise > current.json
+
+if [ $record -eq 1 ] || [ ! -f "$baseline" ]
+then
+    cp current.json "$baseline"
+    echo "*info* baseline recorded in '$baseline'"
+    exit 0
+fi
+
+# compare, reading the one line per workload of both files
+awk -v metrics="$metrics" -v threshold=$threshold '
+function value(line, key,   m) {
+    if (match(line, "\"" key "\": \\{\"mean\": [-0-9.e+]+, \"sd\": [-0-9.e+]+")) {
+	m = substr(line, RSTART, RLENGTH); sub(/.*"mean": /, "", m)
+	split(m, parts, ", \"sd\": "); mean = parts[1] + 0; sd = parts[2] + 0
+	return 1
+    }
+    return 0
+}
+function field(line, key,   m) {
+    if (match(line, "\"" key "\": \"?[^\",]+")) {
+	m = substr(line, RSTART, RLENGTH); sub(/.*: "?/, "", m); return m
+    }
+    return ""
+}
+# two sided 95% t critical values
+function tcrit(df) {
+    split("12.71 4.30 3.18 2.78 2.57 2.45 2.36 2.31 2.26 2.23 2.20 2.18 2.16 2.14 2.13 2.12 2.11 2.10 2.09 2.09 2.08 2.07 2.07 2.06 2.06 2.06 2.05 2.05 2.05 2.04", t, " ")
+    df = int(df); if (df < 1) df = 1
+    return (df <= 30) ? t[df] : 1.96
+}
+BEGIN { nm = split(metrics, names, " "); failed = 0 }
+FNR == NR && /"name"/ {
+    k = field($0, "name"); bn[k] = field($0, "n")
+    for (m = 1; m <= nm; m++) if (value($0, names[m])) { bm[k, m] = mean; bs[k, m] = sd }
+    next
+}
+/"name"/ {
+    k = field($0, "name"); cn = field($0, "n")
+    if (!(k in bn)) { printf "%-22s not in the baseline\n", k; next }
+    for (m = 1; m <= nm; m++) {
+	if (!value($0, names[m])) continue
+	b = bm[k, m]; c = mean; csd = sd
+	if (b == 0 && c == 0) continue
+	# the latencies are histogram buckets, a few us either way is noise
+	latency = (names[m] ~ /us$/ && names[m] != "cpuusPerIO")
+	change = (b != 0) ? 100.0 * (c - b) / b : 100
+	worse = (names[m] == "IOPS" || names[m] == "MiBs") ? -change : change
+	se = sqrt(bs[k, m] ^ 2 / bn[k] + csd ^ 2 / cn)
+	# Welch-Satterthwaite degrees of freedom
+	df = cn + bn[k] - 2
+	if (se > 0) {
+	    a = bs[k, m] ^ 2 / bn[k]; d = csd ^ 2 / cn
+	    if (a + d > 0 && (bn[k] > 1) && (cn > 1)) df = (a + d) ^ 2 / ((a ^ 2) / (bn[k] - 1) + (d ^ 2) / (cn - 1) + 1e-30)
+	}
+	ci = tcrit(df) * csd / sqrt(cn)
+	significant = (se == 0) ? (c != b) : (((c - b) / se > tcrit(df)) || ((c - b) / se < -tcrit(df)))
+	status = "ok"
+	if (latency && c - b < 5 && b - c < 5) significant = 0
+	if (significant && worse > threshold) { status = "REGRESSION"; failed++ }
+	else if (significant && worse < -threshold) { status = "improved" }
+	printf "%-22s %-11s %14.2f -> %14.2f (+/- %.2f) %+7.1f%%  %s\n", k, names[m], b, c, ci, change, status
+    }
+}
+END {
+    if (failed) { printf "*error* %d regression(s)\n", failed; exit 1 }
+    print "*info* no significant regressions"
+}' "$baseline" current.json
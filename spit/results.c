@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "results.h"
+#include "utils.h"
+#include "ioEngine.h"
+
+/**
+ * results.c
+ *
+ * a machine readable JSON document describing a spit run
+ *
+ */
+
+#define RESULTSVERSION 1
+
+void resultsJSONString(FILE *fp, const char *s) {
+  fputc('"', fp);
+  if (s) {
+    for (; *s; s++) {
+      const unsigned char c = *s;
+      if (c == '"' || c == '\\') {
+	fputc('\\', fp); fputc(c, fp);
+      } else if (c < 0x20) {
+	fprintf(fp, "\\u%04x", c);
+      } else {
+	fputc(c, fp);
+      }
+    }
+  }
+  fputc('"', fp);
+}
+
+static double perSecond(const double v, const double elapsed) {
+  return (elapsed > 0) ? v / elapsed : 0;
+}
+
+void resultsLatencyJSON(FILE *fp, const histogramType *h) {
+  fprintf(fp, "{\"count\": %zd, \"mean\": %.6lf, \"p50\": %.6lf, \"p90\": %.6lf, \"p99\": %.6lf, \"p999\": %.6lf, \"max\": %.6lf}",
+	  h->count, histogramMean(h), histogramPercentile(h, 50), histogramPercentile(h, 90), histogramPercentile(h, 99), histogramPercentile(h, 99.9), histogramMax(h));
+}
+
+void resultsThroughputJSON(FILE *fp, const positionContainer *pc, const double elapsed) {
+  fprintf(fp, "\"elapsed\": %.3lf, \"readBytes\": %zd, \"readIOs\": %zd, \"writtenBytes\": %zd, \"writtenIOs\": %zd, ", elapsed, pc->readBytes, pc->readIOs, pc->writtenBytes, pc->writtenIOs);
+  fprintf(fp, "\"readMiBs\": %.2lf, \"readIOPS\": %.0lf, \"writeMiBs\": %.2lf, \"writeIOPS\": %.0lf",
+	  perSecond(TOMiB(pc->readBytes), elapsed), perSecond(pc->readIOs, elapsed), perSecond(TOMiB(pc->writtenBytes), elapsed), perSecond(pc->writtenIOs, elapsed));
+}
+
+void resultsCPUJSON(FILE *fp, const positionContainer *pc) {
+  const size_t ios = pc->readIOs + pc->writtenIOs;
+  const double MiB = TOMiB(pc->readBytes + pc->writtenBytes);
+  const double cpu = pc->cpuUser + pc->cpuSys;
+  fprintf(fp, "{\"user\": %.6lf, \"sys\": %.6lf, \"usPerIO\": %.3lf, \"usPerMiB\": %.3lf, \"voluntaryCtxSwitches\": %zd, \"involuntaryCtxSwitches\": %zd}",
+	  pc->cpuUser, pc->cpuSys, ios ? cpu * 1000000.0 / ios : 0, (MiB > 0) ? cpu * 1000000.0 / MiB : 0, pc->ctxVoluntary, pc->ctxInvoluntary);
+}
+
+static void resultsRampJSON(FILE *fp, const rampStatsType *r, const double setTime, const size_t setCount) {
+  positionContainer pc;
+  positionContainerInit(&pc, 0);
+  pc.readBytes = r->readBytes;
+  pc.readIOs = r->readIOs;
+  pc.writtenBytes = r->writtenBytes;
+  pc.writtenIOs = r->writtenIOs;
+  fprintf(fp, "{\"time\": %.3lf, \"count\": %zd, \"throughput\": {", setTime, setCount);
+  resultsThroughputJSON(fp, &pc, r->seconds);
+  fprintf(fp, "}, \"readLatency\": ");
+  resultsLatencyJSON(fp, &r->readLatency);
+  fprintf(fp, ", \"writeLatency\": ");
+  resultsLatencyJSON(fp, &r->writeLatency);
+  fprintf(fp, "}");
+}
+
+static void resultsDeviceJSON(FILE *fp, const char *device, const size_t bdSize) {
+  if (simDevicePath(device)) {
+    fprintf(fp, "{\"path\": ");
+    resultsJSONString(fp, device);
+    fprintf(fp, ", \"type\": \"simulated\", \"size\": %zd}", bdSize);
+    return;
+  }
+  const int bd = isBlockDevice(device);
+
+  fprintf(fp, "{\"path\": ");
+  resultsJSONString(fp, device);
+  fprintf(fp, ", \"type\": \"%s\", \"size\": %zd", (bd == 1) ? "block" : (bd == 2) ? "file" : "other", (bd == 1) ? blockDeviceSize(device) : fileSizeFromName(device));
+
+  if (bd == 1) { // the queue settings are only in /sys/block for block devices
+    size_t phy = 0, log = 0;
+    char *suffix = getSuffix(device);
+    char *sched = getScheduler(suffix);
+    getPhyLogSizes(suffix, &phy, &log);
+    fprintf(fp, ", \"scheduler\": ");
+    resultsJSONString(fp, sched);
+    fprintf(fp, ", \"physicalBlockSize\": %zd, \"logicalBlockSize\": %zd", phy, log);
+    free(sched);
+    if (suffix) free(suffix);
+  }
+  fprintf(fp, "}");
+}
+
+static void resultsHostJSON(FILE *fp) {
+  char hostname[1000];
+  if (gethostname(hostname, 1000) != 0) hostname[0] = 0;
+  hostname[999] = 0;
+  char *os = OSRelease();
+  char *user = username();
+
+  fprintf(fp, "{\"hostname\": ");
+  resultsJSONString(fp, hostname);
+  fprintf(fp, ", \"osRelease\": ");
+  resultsJSONString(fp, os);
+  fprintf(fp, ", \"user\": ");
+  resultsJSONString(fp, user);
+  fprintf(fp, ", \"cpus\": %zd, \"RAM\": %zd, \"swap\": %zd, \"loadAverage\": %.2lf}", numThreads(), totalRAM(), swapTotal(), loadAverage());
+
+  free(os);
+  free(user);
+}
+
+
+int resultsWriteJSON(const char *fn, const threadInfoType *tc, const size_t num, const jobOptionsType *options, const size_t bdSize, const size_t timetorun, const resultsTimingType *timing) {
+  FILE *fp = fopen(fn, "wt");
+  if (!fp) {
+    perror(fn); return 1;
+  }
+
+  fprintf(fp, "{\n  \"version\": %d,\n  \"commandLine\": ", RESULTSVERSION);
+  resultsJSONString(fp, options->commandLine);
+  fprintf(fp, ",\n  \"UUID\": %zd,\n", num ? tc[0].UUID : 0);
+
+  fprintf(fp, "  \"config\": {\"bdSize\": %zd, \"timeToRun\": %.0lf, \"jobs\": %zd, \"sampleInterval\": %.3lf},\n", bdSize, (timetorun == (size_t)-1) ? -1.0 : (double)timetorun, num, options->sampleInterval);
+
+  fprintf(fp, "  \"host\": ");
+  resultsHostJSON(fp);
+  fprintf(fp, ",\n  \"devices\": [");
+  // the real devices, a stripe's members are listed separately
+  deviceTotalType *devs;
+  CALLOC(devs, num + options->numDevices, sizeof(deviceTotalType));
+  const size_t numDevs = jobDeviceTotals(tc, num, devs);
+  for (size_t d = 0; d < numDevs; d++) {
+    fprintf(fp, "%s\n    ", d ? "," : "");
+    resultsDeviceJSON(fp, devs[d].name, bdSize);
+  }
+  fprintf(fp, "\n  ],\n");
+
+  fprintf(fp, "  \"timing\": {\"setup\": %.3lf, \"run\": %.3lf, \"start\": %.6lf, \"finish\": %.6lf},\n", timing->runStart - timing->setupStart - timing->precondition, timing->runFinish - timing->runStart, timing->runStart, timing->runFinish);
+  if (preconditionEnabled(&options->precondition)) {
+    fprintf(fp, "  \"precondition\": ");
+    preconditionJSON(fp, &options->precondition, timing->precondition, timing->preconditionBytes);
+    fprintf(fp, ",\n");
+  }
+  if (timing->steady.window) {
+    fprintf(fp, "  \"steadyState\": ");
+    steadyStateJSON(fp, &timing->steady);
+    fprintf(fp, ",\n");
+  }
+
+  positionContainer total;
+  positionContainerInit(&total, 0);
+  perfCountersType totalPerf;
+  perfCountersInit(&totalPerf);
+  double maxElapsed = 0;
+
+  fprintf(fp, "  \"jobs\": [\n");
+  for (size_t i = 0; i < num; i++) {
+    const threadInfoType *t = &tc[i];
+    const positionContainer *pc = &t->pos;
+
+    fprintf(fp, "    {\"id\": %zd, \"string\": ", t->id);
+    resultsJSONString(fp, t->jobstring);
+    fprintf(fp, ", \"device\": ");
+    resultsJSONString(fp, t->jobdevice);
+    fprintf(fp, ",\n     \"parsed\": {\"readRatio\": %.3lf, \"blockSize\": %zd, \"highBlockSize\": %zd, \"queueDepth\": %zd, \"seqFiles\": %d, \"flushEvery\": %zd, \"random\": %zd, \"metaData\": %zd, \"positions\": %zd, \"limit\": %.0lf, \"waitFor\": %zd, \"seed\": %u, \"direct\": %d, \"engine\": \"%s\"},\n",
+	    t->rw, t->blockSize, t->highBlockSize, t->queueDepth, t->seqFiles, t->flushEvery, t->random, t->metaData, pc->sz, (t->limit == (size_t)-1) ? -1.0 : (double)t->limit, t->waitfor, t->seed, t->direct ? 1 : 0, ioEngineName(t->engine));
+    fprintf(fp, "     \"throughput\": {");
+    resultsThroughputJSON(fp, pc, pc->elapsedTime);
+    fprintf(fp, "},\n     \"readLatency\": ");
+    resultsLatencyJSON(fp, &pc->readLatency);
+    fprintf(fp, ",\n     \"writeLatency\": ");
+    resultsLatencyJSON(fp, &pc->writeLatency);
+    fprintf(fp, ",\n     \"flush\": ");
+    resultsLatencyJSON(fp, &pc->flushLatency);
+    fprintf(fp, ",\n     \"cpu\": ");
+    resultsCPUJSON(fp, pc);
+    if (options->perfCounters) {
+      fprintf(fp, ",\n     \"perf\": ");
+      perfCountersJSON(fp, &t->perf, pc->readIOs + pc->writtenIOs);
+    }
+    if (pc->warmupTime > 0 || pc->warmupCount) {
+      fprintf(fp, ",\n     \"warmup\": ");
+      resultsRampJSON(fp, &pc->warmup, pc->warmupTime, pc->warmupCount);
+    }
+    if (pc->cooldownTime > 0 || pc->cooldownCount) {
+      fprintf(fp, ",\n     \"cooldown\": ");
+      resultsRampJSON(fp, &pc->cooldown, pc->cooldownTime, pc->cooldownCount);
+    }
+    fprintf(fp, "}%s\n", (i < num - 1) ? "," : "");
+
+    total.readBytes += pc->readBytes;
+    total.readIOs += pc->readIOs;
+    total.writtenBytes += pc->writtenBytes;
+    total.writtenIOs += pc->writtenIOs;
+    histogramMerge(&total.readLatency, &pc->readLatency);
+    histogramMerge(&total.writeLatency, &pc->writeLatency);
+    histogramMerge(&total.flushLatency, &pc->flushLatency);
+    total.cpuUser += pc->cpuUser;
+    total.cpuSys += pc->cpuSys;
+    total.ctxVoluntary += pc->ctxVoluntary;
+    total.ctxInvoluntary += pc->ctxInvoluntary;
+    for (size_t k = 0; k < PERFCOUNTERS; k++) {
+      if (t->perf.valid[k]) {
+	totalPerf.value[k] += t->perf.value[k];
+	totalPerf.valid[k] = 1;
+	totalPerf.anyValid = 1;
+      }
+    }
+    if (pc->elapsedTime > maxElapsed) maxElapsed = pc->elapsedTime;
+  }
+  fprintf(fp, "  ],\n");
+
+  if (numDevs > 1 || options->stripeChunk) {
+    fprintf(fp, "  \"perDevice\": [\n");
+    for (size_t d = 0; d < numDevs; d++) {
+      positionContainer pc;
+      memset(&pc, 0, sizeof(positionContainer));
+      pc.readBytes = devs[d].readBytes;
+      pc.readIOs = devs[d].readIOs;
+      pc.writtenBytes = devs[d].writtenBytes;
+      pc.writtenIOs = devs[d].writtenIOs;
+      fprintf(fp, "    {\"device\": ");
+      resultsJSONString(fp, devs[d].name);
+      fprintf(fp, ", \"jobs\": %zd, \"throughput\": {", devs[d].jobs);
+      resultsThroughputJSON(fp, &pc, maxElapsed);
+      fprintf(fp, "}}%s\n", (d < numDevs - 1) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+  }
+  free(devs);
+
+  fprintf(fp, "  \"aggregate\": {\"throughput\": {");
+  resultsThroughputJSON(fp, &total, maxElapsed);
+  fprintf(fp, "},\n    \"readLatency\": ");
+  resultsLatencyJSON(fp, &total.readLatency);
+  fprintf(fp, ",\n    \"writeLatency\": ");
+  resultsLatencyJSON(fp, &total.writeLatency);
+  fprintf(fp, ",\n    \"flush\": ");
+  resultsLatencyJSON(fp, &total.flushLatency);
+  fprintf(fp, ",\n    \"cpu\": ");
+  resultsCPUJSON(fp, &total);
+  if (options->perfCounters) {
+    fprintf(fp, ",\n    \"perf\": ");
+    perfCountersJSON(fp, &totalPerf, total.readIOs + total.writtenIOs);
+  }
+  fprintf(fp, "}\n}\n");
+
+  fclose(fp);
+  fprintf(stderr,"*info* JSON results written to '%s'\n", fn);
+  return 0;
+}
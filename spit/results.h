@@ -0,0 +1,15 @@
+#ifndef _RESULTS_H
+#define _RESULTS_H
+
+#include <stdio.h>
+
+#include "jobType.h"
+#include "histogram.h"
+
+void resultsJSONString(FILE *fp, const char *s);
+void resultsLatencyJSON(FILE *fp, const histogramType *h);
+void resultsThroughputJSON(FILE *fp, const positionContainer *pc, const double elapsed);
+void resultsCPUJSON(FILE *fp, const positionContainer *pc);
+int  resultsWriteJSON(const char *fn, const threadInfoType *tc, const size_t num, const jobOptionsType *options, const size_t bdSize, const size_t timetorun, const resultsTimingType *timing);
+
+#endif
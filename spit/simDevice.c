@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "simDevice.h"
+#include "utils.h"
+
+/**
+ * simDevice.c
+ *
+ * a device with N channels, each serving one I/O at a time with a service
+ * time drawn from a distribution, plus occasional whole device stalls.
+ * Jobs on the same "sim:..." name share the one device (and its queues)
+ *
+ * e.g. sim:size=1,channels=4,read=80,write=20,flush=500,dist=exp,stall=0.0001:20000,retain
+ *   size in GiB, times in microseconds, stall is probability:duration
+ *
+ */
+
+#define SIMMAXDEVICES 64
+
+static simDeviceType *simDevices[SIMMAXDEVICES];
+static pthread_mutex_t simDevicesLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+int simDevicePath(const char *path) {
+  return path && (strncmp(path, SIMPREFIX, strlen(SIMPREFIX)) == 0);
+}
+
+
+// returns 0 if ok, otherwise prints the problem and returns 1
+int simDeviceParse(simDeviceType *s, const char *spec) {
+  memset(s, 0, sizeof(simDeviceType));
+  s->channels = 1;
+  s->readTime = 100e-6;
+  s->writeTime = 100e-6;
+  s->flushTime = 1e-3;
+  s->dist = SIMFIXED;
+  s->seed = 42;
+
+  if (!simDevicePath(spec)) {
+    fprintf(stderr,"*error* '%s' isn't a simulated device\n", spec);
+    return 1;
+  }
+
+  char *copy = strdup(spec + strlen(SIMPREFIX)), *saveptr = NULL;
+  int bad = 0;
+  for (char *tok = strtok_r(copy, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+    char *value = strchr(tok, '=');
+    if (value) *(value++) = 0;
+
+    if (strcmp(tok, "retain") == 0) {
+      s->retain = 1;
+    } else if (!value) {
+      bad = 1;
+    } else if (strcmp(tok, "size") == 0) {
+      s->size = 1024L * 1024 * 1024 * atof(value);
+    } else if (strcmp(tok, "channels") == 0) {
+      s->channels = MAX(atoi(value), 1);
+    } else if (strcmp(tok, "read") == 0) {
+      s->readTime = atof(value) / 1000000.0;
+    } else if (strcmp(tok, "write") == 0) {
+      s->writeTime = atof(value) / 1000000.0;
+    } else if (strcmp(tok, "flush") == 0) {
+      s->flushTime = atof(value) / 1000000.0;
+    } else if (strcmp(tok, "seed") == 0) {
+      s->seed = atoi(value);
+    } else if (strcmp(tok, "stall") == 0) {
+      char *colon = strchr(value, ':');
+      s->stallProb = atof(value);
+      s->stallTime = colon ? atof(colon + 1) / 1000000.0 : 0;
+    } else if (strcmp(tok, "dist") == 0) {
+      if (strcmp(value, "fixed") == 0) s->dist = SIMFIXED;
+      else if (strcmp(value, "uniform") == 0) s->dist = SIMUNIFORM;
+      else if (strcmp(value, "exp") == 0) s->dist = SIMEXP;
+      else bad = 1;
+    } else {
+      bad = 1;
+    }
+    if (bad) {
+      fprintf(stderr,"*error* unknown simulated device option '%s'\n", tok);
+      break;
+    }
+  }
+  free(copy);
+  return bad;
+}
+
+
+// the size= of the spec in bytes, 0 if not given
+size_t simDeviceSize(const char *spec) {
+  simDeviceType s;
+  if (simDeviceParse(&s, spec) != 0) {
+    exit(-1);
+  }
+  return s.size;
+}
+
+
+void simDeviceDump(FILE *fp, const simDeviceType *s) {
+  const char *dists[] = {"fixed", "uniform", "exp"};
+  fprintf(fp, "*info* simulated device: %.3lf GiB, %zd channel(s), %s service times read %.0lf us, write %.0lf us, flush %.0lf us, stalls %g of %.0lf us, %s\n", TOGiB(s->size), s->channels, dists[s->dist], s->readTime * 1000000, s->writeTime * 1000000, s->flushTime * 1000000, s->stallProb, s->stallTime * 1000000, s->retain ? "retains data" : "data not kept");
+}
+
+
+// the first open creates the device, later opens of the same spec share it
+simDeviceType *simDeviceOpen(const char *spec, const size_t size) {
+  simDeviceType *s = NULL;
+
+  pthread_mutex_lock(&simDevicesLock);
+  for (size_t i = 0; i < SIMMAXDEVICES; i++) {
+    if (simDevices[i] && strcmp(simDevices[i]->spec, spec) == 0) {
+      s = simDevices[i];
+      s->refs++;
+      break;
+    }
+  }
+
+  if (!s) {
+    size_t slot = 0;
+    while (slot < SIMMAXDEVICES && simDevices[slot]) slot++;
+    if (slot == SIMMAXDEVICES) {
+      fprintf(stderr,"*error* too many simulated devices\n");
+      exit(-1);
+    }
+
+    s = calloc(1, sizeof(simDeviceType));
+    if (!s || simDeviceParse(s, spec) != 0) {
+      exit(-1);
+    }
+    if (s->size == 0) s->size = size;
+    s->spec = strdup(spec);
+    s->refs = 1;
+    s->channelFree = calloc(s->channels, sizeof(double));
+    if (s->retain) {
+      if (s->size >= totalRAM() / 2) {
+	fprintf(stderr,"*error* can't retain %.1lf GiB of simulated device in RAM\n", TOGiB(s->size));
+	exit(-1);
+      }
+      s->mem = calloc(s->size, 1);
+    }
+    if (!s->channelFree || (s->retain && !s->mem)) {
+      fprintf(stderr,"*error* out of memory! ooom!!\n");
+      exit(-1);
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    simDevices[slot] = s;
+    simDeviceDump(stderr, s);
+  }
+  pthread_mutex_unlock(&simDevicesLock);
+
+  return s;
+}
+
+
+void simDeviceClose(simDeviceType *s) {
+  pthread_mutex_lock(&simDevicesLock);
+  if (--s->refs == 0) {
+    for (size_t i = 0; i < SIMMAXDEVICES; i++) {
+      if (simDevices[i] == s) simDevices[i] = NULL;
+    }
+    if (s->stalls) {
+      fprintf(stderr,"*info* simulated device stalled %zd time(s)\n", s->stalls);
+    }
+    pthread_mutex_destroy(&s->lock);
+    free(s->channelFree);
+    free(s->mem);
+    free(s->spec);
+    free(s);
+  }
+  pthread_mutex_unlock(&simDevicesLock);
+}
+
+
+// a uniform (0,1], called with the lock held
+static double simRandom(simDeviceType *s) {
+  return (rand_r(&s->seed) + 1.0) / (RAND_MAX + 1.0);
+}
+
+static double simServiceTime(simDeviceType *s, const double mean) {
+  switch (s->dist) {
+  case SIMUNIFORM: return 2 * mean * simRandom(s);
+  case SIMEXP: return -mean * log(simRandom(s));
+  default: return mean;
+  }
+}
+
+
+// queue an I/O on the channel that is free first, returns when it completes
+double simDeviceSubmit(simDeviceType *s, const int write, void *buf, const size_t len, const size_t offset, const double now) {
+  pthread_mutex_lock(&s->lock);
+
+  size_t c = 0;
+  for (size_t i = 1; i < s->channels; i++) {
+    if (s->channelFree[i] < s->channelFree[c]) c = i;
+  }
+  double start = MAX(now, s->channelFree[c]);
+
+  if (s->stallProb > 0 && simRandom(s) < s->stallProb) {
+    // nothing starts until the stall is over
+    start += s->stallTime;
+    for (size_t i = 0; i < s->channels; i++) {
+      s->channelFree[i] = MAX(s->channelFree[i], start);
+    }
+    s->stalls++;
+  }
+
+  const double finish = start + simServiceTime(s, write ? s->writeTime : s->readTime);
+  s->channelFree[c] = finish;
+
+  if (s->mem && offset + len <= s->size) {
+    if (write) {
+      memcpy(s->mem + offset, buf, len);
+    } else {
+      memcpy(buf, s->mem + offset, len);
+    }
+  }
+
+  pthread_mutex_unlock(&s->lock);
+  return finish;
+}
+
+
+// a flush waits for everything queued, then takes its own service time
+double simDeviceFlush(simDeviceType *s, const double now) {
+  pthread_mutex_lock(&s->lock);
+
+  double start = now;
+  for (size_t i = 0; i < s->channels; i++) {
+    start = MAX(start, s->channelFree[i]);
+  }
+  const double finish = start + simServiceTime(s, s->flushTime);
+  for (size_t i = 0; i < s->channels; i++) {
+    s->channelFree[i] = finish;
+  }
+
+  pthread_mutex_unlock(&s->lock);
+  return finish;
+}
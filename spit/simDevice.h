@@ -0,0 +1,43 @@
+#ifndef _SIMDEVICE_H
+#define _SIMDEVICE_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+// an in-process model of a device, named "sim:key=value,..." like a device path
+#define SIMPREFIX "sim:"
+
+#define SIMFIXED 0
+#define SIMUNIFORM 1
+#define SIMEXP 2
+
+typedef struct {
+  char *spec;
+  size_t refs;
+  size_t size;
+  size_t channels;
+  double *channelFree;   // when each channel finishes its queued work
+  double readTime;       // mean service times in seconds
+  double writeTime;
+  double flushTime;
+  int dist;              // SIMFIXED, SIMUNIFORM or SIMEXP
+  double stallProb;      // per I/O chance that the whole device stalls
+  double stallTime;
+  size_t stalls;
+  int retain;            // keep written data so reads return it
+  char *mem;
+  unsigned int seed;
+  pthread_mutex_t lock;
+} simDeviceType;
+
+int    simDevicePath(const char *path);
+int    simDeviceParse(simDeviceType *s, const char *spec);
+size_t simDeviceSize(const char *spec);
+void   simDeviceDump(FILE *fp, const simDeviceType *s);
+
+simDeviceType *simDeviceOpen(const char *spec, const size_t size);
+void   simDeviceClose(simDeviceType *s);
+double simDeviceSubmit(simDeviceType *s, const int write, void *buf, const size_t len, const size_t offset, const double now);
+double simDeviceFlush(simDeviceType *s, const double now);
+
+#endif
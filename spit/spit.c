@@ -11,50 +11,222 @@
  */
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
 
 #include "positions.h"
 #include "utils.h"
+#include "simDevice.h"
+#include "sweep.h"
+#include "devices.h"
 
 #define DEFAULTTIME 10
+
+#define OPTSWEEP 1000
+#define OPTWARMUP 1001
+#define OPTPRECONDITION 1002
+#define OPTCREATE 1003
+#define OPTSTRIPE 1004
+#define OPTLIVE 1005
+#define OPTSTREAM 1006
+#define OPTCONTROL 1007
+#define OPTMETRICS 1008
+#define OPTPOSITIONSTEXT 1009
+#define OPTIOLOG 1010
   
 int verbose = 0;
 int keepRunning = 1;
 
+// a -f or -I device, checked now and sized once all the options are known
+static void addDevice(jobOptionsType *options, const char *device) {
+  if (simDevicePath(device)) { // in-process simulated device
+    simDeviceSize(device); // check the options
+  } else if (!fileExists(device)) { // nothing is there, create a file
+    fprintf(stderr,"*warning* will need to create '%s'\n", device);
+  } else if (!canOpenExclusively(device)) {
+    fprintf(stderr,"*error* can't open '%s' exclusively\n", device);
+    exit(-1);
+  }
+  options->devices = realloc(options->devices, (options->numDevices + 1) * sizeof(char*));
+  options->devices[options->numDevices++] = strdup(device);
+}
+
+// the size to use of a device, -G or the device/file size. Files are created as needed
+static size_t sizeDevice(const char *device, size_t maxSizeInBytes, const jobOptionsType *options) {
+  if (simDevicePath(device)) {
+    // size= of the spec, or -G, or 1 GiB
+    const size_t simSize = simDeviceSize(device);
+    if (simSize) {
+      return simSize;
+    }
+    return maxSizeInBytes ? maxSizeInBytes : 1024L * 1024 * 1024;
+  }
+  const int isAFile = !fileExists(device) || (isBlockDevice(device) == 2);
+  size_t fsize = fileSizeFromName(device);
+  if (isAFile) {
+    if (maxSizeInBytes == 0) { // if not specified use 2 x RAM
+      maxSizeInBytes = totalRAM() * 2;
+    }
+    if (fsize != maxSizeInBytes) { // check the on disk size
+      if (createFile(device, maxSizeInBytes)) {
+	exit(-1);
+      }
+      if (options->createFill) {
+	if (preconditionFillFile(device, maxSizeInBytes)) {
+	  exit(-1);
+	}
+      } else {
+	fprintf(stderr,"*warning* '%s' is only allocated, reads of unwritten extents return zeros without device I/O\n", device);
+      }
+    } else {
+      fprintf(stderr,"*info* reusing '%s', the size matches\n", device);
+    }
+  } else {
+    // if you specify -G too big or it's 0 then set it to the existing file size
+    if (maxSizeInBytes > fsize || maxSizeInBytes == 0) {
+      maxSizeInBytes = fsize;
+    }
+  }
+  return maxSizeInBytes;
+}
+
 int handle_args(int argc, char *argv[], jobType *j, size_t *maxSizeInBytes, size_t *timetorun,
-		 size_t *dumpPositions) {
+		 size_t *dumpPositions, jobOptionsType *options) {
   int opt;
 
-  char *device = NULL;
-  int extraparalleljobs = 0, isAFile = 0;
+  int extraparalleljobs = 0;
   
   jobInit(j);
+  jobOptionsInit(options);
   
-  while ((opt = getopt(argc, argv, "c:f:G:t:j:d:V")) != -1) {
+  const struct option longopts[] = {
+    {"sweep", required_argument, NULL, OPTSWEEP},
+    {"warmup", required_argument, NULL, OPTWARMUP},
+    {"precondition", required_argument, NULL, OPTPRECONDITION},
+    {"create", required_argument, NULL, OPTCREATE},
+    {"stripe", required_argument, NULL, OPTSTRIPE},
+    {"live", no_argument, NULL, OPTLIVE},
+    {"stream", required_argument, NULL, OPTSTREAM},
+    {"control", required_argument, NULL, OPTCONTROL},
+    {"metrics", required_argument, NULL, OPTMETRICS},
+    {"positions-text", no_argument, NULL, OPTPOSITIONSTEXT},
+    {"iolog", required_argument, NULL, OPTIOLOG},
+    {NULL, 0, NULL, 0}
+  };
+
+  while ((opt = getopt_long(argc, argv, "c:f:G:t:j:d:Vi:T:J:pS:I:", longopts, NULL)) != -1) {
     switch (opt) {
+    case OPTSWEEP:
+      options->sweep = optarg;
+      break;
+    case OPTWARMUP:
+      options->sweepWarmup = atoi(optarg);
+      break;
+    case OPTCREATE:
+      if (strcmp(optarg, "alloc") == 0) {
+	options->createFill = 0;
+      } else if (strcmp(optarg, "fill") == 0) {
+	options->createFill = 1;
+      } else {
+	fprintf(stderr,"*error* --create is 'alloc' or 'fill'\n");
+	exit(1);
+      }
+      break;
+    case OPTSTREAM:
+      if (!options->stream) {
+	CALLOC(options->stream, 1, sizeof(statsStreamType));
+      } else {
+	statsStreamClose(options->stream);
+      }
+      if (statsStreamOpen(options->stream, optarg)) {
+	exit(1);
+      }
+      break;
+    case OPTCONTROL:
+      if (options->control) {
+	fprintf(stderr,"*error* only one --control socket\n");
+	exit(1);
+      }
+      CALLOC(options->control, 1, sizeof(controlType));
+      if (controlOpen(options->control, optarg)) {
+	exit(1);
+      }
+      break;
+    case OPTMETRICS:
+      if (options->metrics) {
+	fprintf(stderr,"*error* only one --metrics endpoint\n");
+	exit(1);
+      }
+      CALLOC(options->metrics, 1, sizeof(metricsType));
+      if (metricsOpen(options->metrics, optarg)) {
+	exit(1);
+      }
+      break;
+    case OPTPOSITIONSTEXT:
+      options->positionsText = 1;
+      break;
+    case OPTIOLOG:
+      options->ioLogPrefix = optarg;
+      break;
+    case OPTLIVE:
+      options->live = 1;
+      break;
+    case OPTSTRIPE:
+      options->stripeChunk = 1024 * (size_t)atoi(optarg);
+      if (options->stripeChunk == 0) {
+	fprintf(stderr,"*error* --stripe is the chunk size in KiB\n");
+	exit(1);
+      }
+      break;
+    case OPTPRECONDITION:
+      if (preconditionParse(&options->precondition, optarg)) {
+	exit(1);
+      }
+      break;
     case 'c':
       jobAdd(j, optarg);
       break;
     case 'd':
       *dumpPositions = atoi(optarg);
       break;
+    case 'i':
+      options->sampleInterval = atof(optarg);
+      if (options->sampleInterval < 0.01) {
+	fprintf(stderr,"*warning* sample interval increased to 0.01 seconds\n");
+	options->sampleInterval = 0.01;
+      }
+      break;
+    case 'T':
+      options->timeSeriesPrefix = optarg;
+      break;
+    case 'J':
+      options->resultsFilename = optarg;
+      break;
+    case 'p':
+      options->perfCounters = 1;
+      break;
+    case 'S':
+      if (steadyStateParse(optarg, &options->steadyWindow, &options->steadyExcursion, &options->steadySlope)) {
+	exit(1);
+      }
+      break;
     case 'f':
-      device = optarg;
-      if (!fileExists(device)) { // nothing is there, create a file
-	fprintf(stderr,"*warning* will need to create '%s'\n", device);
-	isAFile = 1;
-      } else {
-	// it's there
-	if (isBlockDevice(device) == 2) {
-	  // it's a file
-	  isAFile = 1;
-	} 
-	
-	if (!canOpenExclusively(device)) {
-	  fprintf(stderr,"*error* can't open '%s' exclusively\n", device);
-	  exit(-1);
-	}
+      addDevice(options, optarg);
+      break;
+    case 'I': {
+      // a file of devices, one per line
+      deviceDetails *devs = NULL;
+      size_t numDevs = 0;
+      loadDeviceDetails(optarg, &devs, &numDevs);
+      if (numDevs == 0) {
+	fprintf(stderr,"*error* no devices in '%s'\n", optarg);
+	exit(1);
       }
+      for (size_t i = 0; i < numDevs; i++) {
+	addDevice(options, devs[i].devicename);
+      }
+      freeDeviceDetails(devs, numDevs);
       break;
+    }
     case 'G':
       *maxSizeInBytes = 1024 * (size_t)(atof(optarg) * 1024 * 1024);
       break;
@@ -77,34 +249,53 @@ int handle_args(int argc, char *argv[], jobType *j, size_t *maxSizeInBytes, size
     }
   }
 
-  if (!device) {
+  if (options->numDevices == 0) {
     //    fprintf(stderr,"*error* you are missing the -f device\n");
     return 1;
   }
 
-  // first assign the device
-  jobAddDeviceToAll(j, device);
+  if (options->stripeChunk) {
+    for (size_t d = 0; d < options->numDevices; d++) {
+      if (simDevicePath(options->devices[d])) {
+	fprintf(stderr,"*error* --stripe needs real devices, not '%s'\n", options->devices[d]);
+	exit(1);
+      }
+    }
+  }
+
+  // a sweep makes its own job strings, -c is optional
+  if (options->sweep && j->count == 0) {
+    jobAdd(j, "");
+  }
+
+  // first assign the devices, every job on each device or striped over them all
+  jobAssignDevices(j, options);
+  if (options->stripeChunk) {
+    fprintf(stderr,"*info* striping each job over %zd devices, %zd KiB chunks\n", options->numDevices, options->stripeChunk / 1024);
+  } else if (options->numDevices > 1) {
+    fprintf(stderr,"*info* running every job on each of %zd devices\n", options->numDevices);
+  }
   
   // scale up using the -j option
   if (extraparalleljobs) {
     jobMultiply(j, extraparalleljobs);
   }
 
-  // check the file, create or resize
-  size_t fsize = fileSizeFromName(device);
-  if (isAFile) {
-    if (*maxSizeInBytes == 0) { // if not specified use 2 x RAM
-      *maxSizeInBytes = totalRAM() * 2;
+  // check the files, create or resize. The smallest device sets the size
+  size_t smallest = 0, largest = 0;
+  for (size_t d = 0; d < options->numDevices; d++) {
+    const size_t size = sizeDevice(options->devices[d], *maxSizeInBytes, options);
+    if (d == 0 || size < smallest) {
+      smallest = size;
     }
-    if (fsize != *maxSizeInBytes) { // check the on disk size
-      createFile(device, *maxSizeInBytes);
-    }
-  } else {
-    // if you specify -G too big or it's 0 then set it to the existing file size
-    if (*maxSizeInBytes > fsize || *maxSizeInBytes == 0) {
-      *maxSizeInBytes = fsize;
+    if (size > largest) {
+      largest = size;
     }
   }
+  if (smallest != largest) {
+    fprintf(stderr,"*info* using the smallest device size on all devices\n");
+  }
+  *maxSizeInBytes = smallest;
 
   return 0;
 }
@@ -138,7 +329,34 @@ void usage() {
   fprintf(stderr,"  spit -f ... -c m              # non-unique positions, read/write/flush like (m)eta-data\n");
   fprintf(stderr,"  spit -f ... -c mP4000         # non-unique 4000 positions, read/write/flush like (m)eta-data\n");
   fprintf(stderr,"  spit -f ... -c n              # 100,000 (n)on-unique positions, read/write, reseeding every 100,000\n");
+  fprintf(stderr,"  spit -f ... -c rN             # (N)ull engine, completes I/Os without the device, measures spit itself\n");
+  fprintf(stderr,"  spit -f sim:channels=4,read=80,write=20,dist=exp -c rs0  # simulated device, times in us\n");
+  fprintf(stderr,"  spit -f sim:size=1,flush=500,stall=0.0001:20000,retain -c m  # 1 GiB, stalls, keeps data to verify\n");
+  fprintf(stderr,"  spit -f ... -c rs0u10d2       # 10 s warm-up, 2 s cool-down, not in the stats but reported\n");
+  fprintf(stderr,"  spit -f ... -c rs0u5000id100i # the first 5000 and the last 100 I/Os are excluded\n");
   fprintf(stderr,"  spit -f ... -c rL4            # (L)imit positions so the sum of the length is 4 GiB\n");
+  fprintf(stderr,"  spit -f ... -c w -c rs0 --live   # every second a line per job, MiB/s, IOPS, size and latency percentiles\n");
+  fprintf(stderr,"  spit -f ... --stream -          # every second a JSON line of per job, total and device stats on stdout\n");
+  fprintf(stderr,"  spit -f ... --stream fifo       # or to a file or named pipe, lines are dropped if the reader falls behind\n");
+  fprintf(stderr,"  spit -f ... --control /tmp/spit.sock  # e.g. echo 'qd 0 8' | nc -U /tmp/spit.sock, also stats, histograms, pause, resume, rate, stop, help\n");
+  fprintf(stderr,"  spit -f ... --metrics 9400       # Prometheus metrics on http://127.0.0.1:9400/metrics, or a Unix socket path\n");
+  fprintf(stderr,"  spit -f ... --positions-text    # spit-positions-NNN.txt as text, not the binary .bin (spitchecker -x converts)\n");
+  fprintf(stderr,"  spit -f ... -c n --iolog io     # stream every completed I/O to io-000.bin ... during the run\n");
+  fprintf(stderr,"  spit -f ... -T ts             # per job time series in ts-000.csv, ts-001.csv ...\n");
+  fprintf(stderr,"  spit -f ... -T ts.ndjson      # per job time series as NDJSON in ts-000.ndjson ...\n");
+  fprintf(stderr,"  spit -f ... -T ts -i 0.01     # sample the time series every 10 ms (default 1 s)\n");
+  fprintf(stderr,"  spit -f ... -J results.json   # write the config, per job results and latencies as JSON\n");
+  fprintf(stderr,"  spit -f ... -p                # per job CPU perf counters (cycles, IPC, cache/dTLB misses) per IO\n");
+  fprintf(stderr,"  spit -f ... -S 60 -t 7200      # stop at steady state, IOPS and latency over 60 s within 20%% range, 10%% slope\n");
+  fprintf(stderr,"  spit -f ... -S 300,10,5       # 300 s window, 10%% excursion, 5%% slope (-t is the limit)\n");
+  fprintf(stderr,"  spit -f file --create alloc    # a new file is only fallocated, by default it's also filled with random data\n");
+  fprintf(stderr,"  spit -f ... --precondition 2   # first write the device twice, 1 MiB x QD 32 over 8 sequential streams\n");
+  fprintf(stderr,"  spit -f ... --precondition 2,1:k512q64s16  # then 1 device size of random 4 KiB writes, 512 KiB x QD 64 x 16 streams\n");
+  fprintf(stderr,"  spit -f a -f b -c rs0          # every -c on each device, per device and total results\n");
+  fprintf(stderr,"  spit -I devices.txt -c rs0    # the devices listed in a file, one per line\n");
+  fprintf(stderr,"  spit -f a -f b --stripe 128 -c rs0  # stripe each job over the devices in 128 KiB chunks\n");
+  fprintf(stderr,"  spit -f ... --sweep \"k=4,64 q=1,32 rw=1,0.5,0 s=0,1 j=1,4\" -t 30  # every combination, 30 s each\n");
+  fprintf(stderr,"  spit -f ... -c D --sweep \"q=1,2,4,8\" --warmup 5  # -c is the template, 5 s unmeasured per cell\n");
   exit(-1);
 }
 
@@ -159,6 +377,7 @@ int main(int argc, char *argv[]) {
 
   jobType *j = malloc(sizeof(jobType));
   size_t maxSizeInBytes = 0, timetorun = DEFAULTTIME, dumpPositions = 0;
+  jobOptionsType options;
 
   // don't run if swap is on
   if (swapTotal() > 0) {
@@ -173,7 +392,8 @@ int main(int argc, char *argv[]) {
   
   fprintf(stderr,"*info* spit %s %s (Stu's parallel I/O tester)\n", argv[0], VERSION);
   
-  handle_args(argc, argv, j, &maxSizeInBytes, &timetorun, &dumpPositions);
+  handle_args(argc, argv, j, &maxSizeInBytes, &timetorun, &dumpPositions, &options);
+  options.commandLine = commandLine(argc, argv);
   if (j->count == 0) {
     usage();
   }
@@ -182,10 +402,44 @@ int main(int argc, char *argv[]) {
   signal(SIGINT, intHandler);
 
   fprintf(stderr,"*info* bdSize %.3lf GiB (%zd bytes, %.3lf PiB), time to run %zd sec\n", TOGiB(maxSizeInBytes), maxSizeInBytes, TOPiB(maxSizeInBytes), timetorun);
-  jobRunThreads(j, j->count, maxSizeInBytes, timetorun, dumpPositions);
+  if (options.sweep) {
+    sweepType sweep;
+    if (sweepParse(&sweep, options.sweep)) {
+      exit(1);
+    }
+    sweep.warmup = options.sweepWarmup;
+    // the first -c is the template for every cell, -j the jobs if not swept
+    for (int i = 1; i < j->count; i++) {
+      if (strcmp(j->strings[i], j->strings[0]) != 0) {
+	fprintf(stderr,"*warning* --sweep only uses the first -c string '%s'\n", j->strings[0]);
+	break;
+      }
+    }
+    sweepRun(&sweep, j->strings[0], j->count / (options.stripeChunk ? 1 : options.numDevices), maxSizeInBytes, timetorun, &options);
+    sweepFree(&sweep);
+  } else {
+    jobRunThreads(j, j->count, maxSizeInBytes, timetorun, dumpPositions, &options);
+  }
 
   jobFree(j);
   free(j);
+  free(options.commandLine);
+  if (options.metrics) {
+    metricsClose(options.metrics);
+    free(options.metrics);
+  }
+  if (options.control) {
+    controlClose(options.control);
+    free(options.control);
+  }
+  if (options.stream) {
+    statsStreamClose(options.stream);
+    free(options.stream);
+  }
+  for (size_t d = 0; d < options.numDevices; d++) {
+    free(options.devices[d]);
+  }
+  free(options.devices);
 
   exit(0);
 }
@@ -0,0 +1,299 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+/**
+ * spitbench.c
+ *
+ * micro-benchmarks of the spitlib functions that dominate setup and
+ * post-processing time. Each is warmed up, then timed over repetitions,
+ * reporting the median ns/op and ops/s
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "positions.h"
+#include "positionLog.h"
+#include "utils.h"
+#include "logSpeed.h"
+#include "results.h"
+
+int verbose = 0;
+int keepRunning = 1;
+
+#define BDSIZE (100L * 1024 * 1024 * 1024)
+
+typedef struct {
+  size_t n;              // the number of ops each run does
+  positionType *positions;
+  char *buffer;
+  char *expected;
+  char *filename;
+} benchStateType;
+
+typedef struct {
+  const char *name;
+  size_t n;
+  void (*fn)(benchStateType *s);
+} benchType;
+
+static volatile size_t sink = 0; // stop results being optimised away
+
+
+static void benchRandomBlockSize(benchStateType *s) {
+  size_t sum = 0;
+  for (size_t i = 0; i < s->n; i++) {
+    sum += randomBlockSize(4096, 65536, 12, i * 2654435761UL);
+  }
+  sink = sum;
+}
+
+static void benchSetupPositions(benchStateType *s, const int sf) {
+  size_t num = s->n;
+  sink = setupPositions(s->positions, &num, sf, 0.5, 4096, 4096, 4096, -99999, BDSIZE, 42, 0);
+}
+
+static void benchSetupPositionsSeq(benchStateType *s) {
+  benchSetupPositions(s, 1);
+}
+
+static void benchSetupPositionsParallel(benchStateType *s) {
+  benchSetupPositions(s, 32);
+}
+
+static void benchSetupPositionsShuffled(benchStateType *s) {
+  benchSetupPositions(s, 0);
+}
+
+static void benchSetupRandomPositions(benchStateType *s) {
+  sink = setupRandomPositions(s->positions, s->n, 0.5, 4096, 65536, 4096, BDSIZE, 42, 0);
+}
+
+// an op is 4 KiB generated
+static void benchGenerateRandomBufferCyclic(benchStateType *s) {
+  generateRandomBufferCyclic(s->buffer, s->n * 4096, 42, 65536);
+  sink = s->buffer[0];
+}
+
+static void benchLogSpeedAdd2(benchStateType *s) {
+  logSpeedType l;
+  logSpeedInit(&l);
+  for (size_t i = 0; i < s->n; i++) {
+    logSpeedAdd2(&l, 4096, 1);
+  }
+  sink = logSpeedN(&l);
+  logSpeedFree(&l);
+}
+
+// the input of the save, load and verify benchmarks, whatever ran before
+static void benchFixedPositions(benchStateType *s) {
+  size_t num = s->n;
+  setupPositions(s->positions, &num, 0, 0.5, 4096, 4096, 4096, -99999, BDSIZE, 42, 0);
+}
+
+static void fillContainer(positionContainer *pc, benchStateType *s) {
+  positionContainerInit(pc, 0);
+  pc->positions = s->positions;
+  pc->sz = s->n;
+  pc->device = "/dev/null";
+  for (size_t i = 0; i < s->n; i++) {
+    s->positions[i].success = 1;
+  }
+}
+
+static void benchPositionContainerSave(benchStateType *s) {
+  positionContainer pc;
+  fillContainer(&pc, s);
+  positionContainerSave(&pc, s->filename, BDSIZE, 0);
+}
+
+static void benchPositionContainerLoad(benchStateType *s) {
+  FILE *fp = fopen(s->filename, "rt");
+  if (!fp) {
+    perror(s->filename); exit(1);
+  }
+  positionContainer pc;
+  positionContainerLoad(&pc, fp); // closes fp
+  sink = pc.sz;
+  positionContainerFree(&pc);
+}
+
+static void benchPositionLogSave(benchStateType *s) {
+  positionContainer pc;
+  fillContainer(&pc, s);
+  positionLogSave(&pc, s->filename, BDSIZE, 0, 42);
+}
+
+static void benchPositionLogLoad(benchStateType *s) {
+  const int fd = open(s->filename, O_RDONLY);
+  positionLogMapType m;
+  if (fd < 0 || positionLogMap(&m, fd)) {
+    perror(s->filename); exit(1);
+  }
+  positionContainer pc;
+  positionLogLoad(&pc, &m);
+  positionLogUnmap(&m);
+  close(fd);
+  sink = pc.sz;
+  positionContainerFree(&pc);
+}
+
+// an op is a 4 KiB block checked against the expected contents
+static void benchVerifyCompare(benchStateType *s) {
+  size_t ok = 0;
+  for (size_t i = 0; i < s->n; i++) {
+    positionType p = s->positions[i];
+    p.len = 4096;
+    memcpy(s->buffer, &p.pos, sizeof(size_t));
+    ok += (positionVerifyBlock(&p, s->buffer, s->expected) == 0);
+  }
+  sink = ok;
+}
+
+
+static int doublecompare(const void *p1, const void *p2) {
+  const double d1 = *(const double*)p1, d2 = *(const double*)p2;
+  return (d1 < d2) ? -1 : (d1 > d2) ? 1 : 0;
+}
+
+static void usage() {
+  fprintf(stderr,"Usage: spitbench [-r repetitions] [-w warmups] [-s scale] [-b name] [-J results.json]\n");
+  fprintf(stderr,"  -r 5        timed repetitions per benchmark, the median is reported (default 5)\n");
+  fprintf(stderr,"  -w 1        untimed warm-up runs (default 1)\n");
+  fprintf(stderr,"  -s 1        multiply the ops per run\n");
+  fprintf(stderr,"  -b setup    only run benchmarks whose name contains 'setup'\n");
+  fprintf(stderr,"  -J file     write the results as JSON\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[]) {
+  size_t reps = 5, warmups = 1;
+  double scale = 1;
+  char *only = NULL, *jsonFilename = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:w:s:b:J:")) != -1) {
+    switch (opt) {
+    case 'r': reps = MAX(atoi(optarg), 1); break;
+    case 'w': warmups = MAX(atoi(optarg), 0); break;
+    case 's': scale = atof(optarg); break;
+    case 'b': only = optarg; break;
+    case 'J': jsonFilename = optarg; break;
+    default: usage(); break;
+    }
+  }
+  if (scale <= 0) usage();
+
+  const benchType benches[] = {
+    {"randomBlockSize", 10000000, benchRandomBlockSize},
+    {"setupPositions-sequential", 1000000, benchSetupPositionsSeq},
+    {"setupPositions-parallel32", 1000000, benchSetupPositionsParallel},
+    {"setupPositions-shuffled", 1000000, benchSetupPositionsShuffled},
+    {"setupRandomPositions", 1000000, benchSetupRandomPositions},
+    {"generateRandomBufferCyclic-4KiB", 16384, benchGenerateRandomBufferCyclic},
+    {"logSpeedAdd2", 10000000, benchLogSpeedAdd2},
+    {"positionContainerSave", 200000, benchPositionContainerSave},
+    {"positionContainerLoad", 200000, benchPositionContainerLoad},
+    {"positionLogSave", 200000, benchPositionLogSave},
+    {"positionLogLoad", 200000, benchPositionLogLoad},
+    {"verifyCompare-4KiB", 1000000, benchVerifyCompare}
+  };
+  const size_t numBenches = sizeof(benches) / sizeof(benches[0]);
+
+  // sized for the largest benchmark
+  size_t maxN = 0;
+  for (size_t b = 0; b < numBenches; b++) {
+    if (benches[b].n * scale > maxN) maxN = benches[b].n * scale;
+  }
+  benchStateType s;
+  memset(&s, 0, sizeof(s));
+  s.positions = createPositions(maxN);
+  CALLOC(s.buffer, 16384 * scale + 1, 4096);
+  CALLOC(s.expected, 4096, 1);
+  generateRandomBuffer(s.expected, 4096, 42);
+  memcpy(s.buffer, s.expected, 4096);
+
+  char tmpname[] = "/tmp/spitbench-XXXXXX";
+  int tmpfd = mkstemp(tmpname);
+  if (tmpfd < 0) {
+    perror(tmpname); exit(1);
+  }
+  close(tmpfd);
+  s.filename = tmpname;
+
+  FILE *json = NULL;
+  if (jsonFilename) {
+    json = fopen(jsonFilename, "wt");
+    if (!json) {
+      perror(jsonFilename); exit(1);
+    }
+    fprintf(json, "{\n  \"reps\": %zd,\n  \"warmups\": %zd,\n  \"scale\": %g,\n  \"benchmarks\": [\n", reps, warmups, scale);
+  }
+
+  double *times;
+  CALLOC(times, reps, sizeof(double));
+
+  printf("%-34s %12s %14s %12s %12s\n", "benchmark", "ops", "ops/s", "ns/op", "min ns/op");
+  size_t printed = 0;
+  for (size_t b = 0; b < numBenches; b++) {
+    if (only && !strstr(benches[b].name, only)) continue;
+    s.n = benches[b].n * scale;
+
+    if (strstr(benches[b].name, "Save") || strstr(benches[b].name, "Load") || strstr(benches[b].name, "verifyCompare")) {
+      benchFixedPositions(&s);
+    }
+    if (strcmp(benches[b].name, "positionContainerLoad") == 0) {
+      benchPositionContainerSave(&s); // what's loaded, from the fixed positions
+    }
+    if (strcmp(benches[b].name, "positionLogLoad") == 0) {
+      benchPositionLogSave(&s);
+    }
+    if (strcmp(benches[b].name, "verifyCompare-4KiB") == 0) {
+      memcpy(s.buffer, s.expected, 4096);
+    }
+
+    for (size_t w = 0; w < warmups; w++) {
+      benches[b].fn(&s);
+    }
+    for (size_t r = 0; r < reps; r++) {
+      const double start = timedouble();
+      benches[b].fn(&s);
+      times[r] = timedouble() - start;
+    }
+    qsort(times, reps, sizeof(double), doublecompare);
+
+    const double median = (reps % 2) ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+    const double nsPerOp = median * 1e9 / s.n;
+    printf("%-34s %12zd %14.0lf %12.2lf %12.2lf\n", benches[b].name, s.n, s.n / median, nsPerOp, times[0] * 1e9 / s.n);
+    fflush(stdout);
+
+    if (json) {
+      fprintf(json, "%s    {\"name\": ", printed ? ",\n" : "");
+      resultsJSONString(json, benches[b].name);
+      fprintf(json, ", \"ops\": %zd, \"opsPerSec\": %.1lf, \"nsPerOp\": %.3lf, \"minNsPerOp\": %.3lf, \"maxNsPerOp\": %.3lf, \"times\": [", s.n, s.n / median, nsPerOp, times[0] * 1e9 / s.n, times[reps - 1] * 1e9 / s.n);
+      for (size_t r = 0; r < reps; r++) {
+	fprintf(json, "%s%.6lf", r ? ", " : "", times[r]);
+      }
+      fprintf(json, "]}");
+    }
+    printed++;
+  }
+
+  if (json) {
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+    fprintf(stderr,"*info* JSON results written to '%s'\n", jsonFilename);
+  }
+
+  unlink(tmpname);
+  free(times);
+  free(s.expected);
+  free(s.buffer);
+  freePositions(s.positions);
+
+  exit(0);
+}
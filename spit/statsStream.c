@@ -0,0 +1,217 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "statsStream.h"
+#include "utils.h"
+
+#define STATSSTREAMBUFFER (4*1024*1024)
+
+// stdout, take what's queued and write it, blocking here and not in the timer
+static void *statsStreamWriter(void *arg) {
+  statsStreamType *s = (statsStreamType*)arg;
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL); // only in the write, not holding the lock
+
+  pthread_mutex_lock(&s->lock);
+  while (1) {
+    while (s->len == 0 && !s->closing) {
+      pthread_cond_wait(&s->cond, &s->lock);
+    }
+    if (s->len == 0) { // closing and all written
+      break;
+    }
+    const size_t n = s->len;
+    memcpy(s->out, s->buf, n);
+    s->len = 0;
+    s->writing = n;
+    pthread_mutex_unlock(&s->lock);
+
+    size_t done = 0;
+    int failed = 0;
+    while (done < n) {
+      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+      const ssize_t w = write(s->fd, s->out + done, n - done);
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+      if (w < 0) {
+	if (errno == EINTR) continue;
+	perror(s->name); // the reader has gone, stop streaming
+	failed = 1;
+	break;
+      }
+      done += w;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->writing = 0;
+    if (failed) {
+      s->fd = -1;
+      s->len = 0;
+      break;
+    }
+  }
+  s->writerDone = 1;
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+
+// returns 0 if open
+int statsStreamOpen(statsStreamType *s, const char *name) {
+  memset(s, 0, sizeof(statsStreamType));
+  s->name = strdup(name);
+  s->size = STATSSTREAMBUFFER;
+  CALLOC(s->buf, s->size, 1);
+
+  if (strcmp(name, "-") == 0) {
+    s->fd = fileno(stdout); // left blocking, stdout is shared with the sweep table
+    s->threaded = 1;
+    CALLOC(s->out, s->size, 1);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->writer, NULL, statsStreamWriter, s)) {
+      perror("pthread_create");
+      s->threaded = 0;
+      s->fd = -1;
+      return 1;
+    }
+    return 0;
+  }
+
+  struct stat st;
+  const int isFIFO = (stat(name, &st) == 0) && S_ISFIFO(st.st_mode);
+  if (isFIFO) {
+    fprintf(stderr,"*info* waiting for a reader on '%s'\n", name);
+  }
+  s->fd = open(name, O_WRONLY | O_CREAT | (isFIFO ? 0 : O_TRUNC), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (s->fd < 0) {
+    perror(name);
+    return 1;
+  }
+  if (isFIFO) {
+    signal(SIGPIPE, SIG_IGN); // a reader going away is an EPIPE, not the end of the run
+    fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) | O_NONBLOCK);
+    s->nonBlocking = 1;
+  }
+  fprintf(stderr,"*info* streaming NDJSON stats to '%s'\n", name);
+  return 0;
+}
+
+
+// write what the fd takes now, the rest stays in the buffer
+static void statsStreamFlush(statsStreamType *s) {
+  size_t done = 0;
+  while (done < s->len) {
+    const ssize_t w = write(s->fd, s->buf + done, s->len - done);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN) { // the reader has gone, stop streaming
+	perror(s->name);
+	close(s->fd);
+	s->fd = -1;
+	s->len = 0;
+	return;
+      }
+      break;
+    }
+    done += w;
+  }
+  memmove(s->buf, s->buf + done, s->len - done);
+  s->len -= done;
+}
+
+
+// queue a line for the writer thread, it's dropped if the buffer is full
+static void statsStreamQueue(statsStreamType *s, const char *line, const size_t len) {
+  pthread_mutex_lock(&s->lock);
+  if (s->fd >= 0) {
+    if (s->len + len > s->size) {
+      s->dropped++;
+    } else {
+      memcpy(s->buf + s->len, line, len);
+      s->len += len;
+      s->lines++;
+      pthread_cond_signal(&s->cond);
+    }
+  }
+  pthread_mutex_unlock(&s->lock);
+}
+
+
+void statsStreamWrite(statsStreamType *s, const char *line, const size_t len) {
+  if (s->threaded) {
+    statsStreamQueue(s, line, len);
+    return;
+  }
+  if (s->fd < 0) {
+    return;
+  }
+  if (s->len + len > s->size) {
+    s->dropped++;
+  } else {
+    memcpy(s->buf + s->len, line, len);
+    s->len += len;
+    s->lines++;
+  }
+  statsStreamFlush(s);
+}
+
+
+// give a slow reader a second to take the rest, then stop the writer thread
+static void statsStreamStopWriter(statsStreamType *s) {
+  pthread_mutex_lock(&s->lock);
+  s->closing = 1;
+  pthread_cond_signal(&s->cond);
+  int done = s->writerDone;
+  pthread_mutex_unlock(&s->lock);
+  for (size_t i = 0; i < 100 && !done; i++) {
+    usleep(10000);
+    pthread_mutex_lock(&s->lock);
+    done = s->writerDone;
+    pthread_mutex_unlock(&s->lock);
+  }
+  if (!done) {
+    pthread_cancel(s->writer); // blocked in the write
+  }
+  pthread_join(s->writer, NULL);
+
+  if (s->len || s->writing || s->dropped) {
+    fprintf(stderr,"*warning* stream '%s' dropped %zd of %zd lines, %zd bytes not written\n", s->name, s->dropped, s->lines + s->dropped, s->len + s->writing);
+  }
+  s->fd = -1;
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->cond);
+  free(s->out);
+  s->out = NULL;
+}
+
+
+void statsStreamClose(statsStreamType *s) {
+  if (s->threaded) {
+    if (s->buf) {
+      statsStreamStopWriter(s);
+    }
+  } else if (s->fd >= 0) {
+    // give a slow reader a second to take the rest
+    for (size_t i = 0; i < 100 && s->len; i++) {
+      statsStreamFlush(s);
+      if (s->len) usleep(10000);
+    }
+    if (s->len || s->dropped) {
+      fprintf(stderr,"*warning* stream '%s' dropped %zd of %zd lines, %zd bytes not written\n", s->name, s->dropped, s->lines + s->dropped, s->len);
+    }
+    close(s->fd);
+    s->fd = -1;
+  }
+  free(s->buf);
+  s->buf = NULL;
+  free(s->name);
+  s->name = NULL;
+}
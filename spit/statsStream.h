@@ -0,0 +1,35 @@
+#ifndef _STATSSTREAM_H
+#define _STATSSTREAM_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* --stream, one JSON object per line every second to stdout ("-"), a file
+ * or a named pipe. Lines are queued in a buffer and written by the timer
+ * thread. A pipe is non-blocking. stdout is shared so it stays blocking, and
+ * a writer thread takes the buffer instead. Either way if the reader falls
+ * behind and the buffer is full whole lines are dropped and counted */
+typedef struct {
+  int fd;
+  char *name;
+  int nonBlocking;
+  int threaded;         // stdout, written by the writer thread
+  int closing;
+  int writerDone;
+  size_t writing;       // bytes the writer thread has taken out of buf
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  char *out;            // what the writer thread is writing
+  char *buf;
+  size_t len;
+  size_t size;
+  size_t lines;
+  size_t dropped;
+} statsStreamType;
+
+int  statsStreamOpen(statsStreamType *s, const char *name);
+void statsStreamWrite(statsStreamType *s, const char *line, const size_t len);
+void statsStreamClose(statsStreamType *s);
+
+#endif
@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "steadyState.h"
+#include "utils.h"
+
+static const char *steadyNames[STEADYMETRICS] = {"IOPS", "latency"};
+
+
+// "60" or "60,20,10", the window in seconds then the excursion and slope in %
+int steadyStateParse(const char *spec, size_t *window, double *maxExcursion, double *maxSlope) {
+  double w = 0, excursion = 20, slope = 10;
+  const int n = sscanf(spec, "%lf,%lf,%lf", &w, &excursion, &slope);
+  if (n < 1 || w < 2 || excursion <= 0 || slope <= 0) {
+    fprintf(stderr,"*error* steady state needs a window of at least 2 seconds, e.g. -S 60 or -S 60,20,10\n");
+    return 1;
+  }
+  *window = (size_t)w;
+  *maxExcursion = excursion / 100.0;
+  *maxSlope = slope / 100.0;
+  return 0;
+}
+
+
+void steadyStateInit(steadyStateType *s, const size_t window, const double maxExcursion, const double maxSlope) {
+  memset(s, 0, sizeof(steadyStateType));
+  s->window = window;
+  s->maxExcursion = maxExcursion;
+  s->maxSlope = maxSlope;
+  for (size_t m = 0; m < STEADYMETRICS && window; m++) {
+    CALLOC(s->samples[m], window, sizeof(double));
+  }
+}
+
+
+// the mean, the range and the range of the least squares line, oldest sample first
+static void steadyStateWindow(steadyStateType *s, const size_t m) {
+  const size_t n = s->window, first = s->count % n;
+  double sum = 0, sumx = 0, sumxy = 0, sumxx = 0, lo = 0, hi = 0;
+  for (size_t i = 0; i < n; i++) {
+    const double y = s->samples[m][(first + i) % n];
+    if (i == 0 || y < lo) lo = y;
+    if (i == 0 || y > hi) hi = y;
+    sum += y;
+    sumx += i;
+    sumxy += i * y;
+    sumxx += (double)i * i;
+  }
+  const double mean = sum / n;
+  const double slope = (n * sumxy - sumx * sum) / (n * sumxx - sumx * sumx);
+  s->mean[m] = mean;
+  s->excursion[m] = hi - lo;
+  s->slope[m] = fabs(slope) * (n - 1);
+}
+
+
+// add a second's sample, returns 1 once every metric is steady
+int steadyStateAdd(steadyStateType *s, const double elapsed, const double iops, const double latency) {
+  if (s->window == 0) return 0;
+
+  s->samples[STEADYIOPS][s->count % s->window] = iops;
+  s->samples[STEADYLATENCY][s->count % s->window] = latency;
+  s->count++;
+  if (s->count < s->window) return 0;
+
+  int steady = 1;
+  for (size_t m = 0; m < STEADYMETRICS; m++) {
+    steadyStateWindow(s, m);
+    const double mean = s->mean[m];
+    if (mean <= 0 || s->excursion[m] > s->maxExcursion * mean || s->slope[m] > s->maxSlope * mean) {
+      steady = 0;
+    }
+  }
+  if (steady && !s->reached) {
+    s->reached = 1;
+    s->reachedAt = elapsed;
+  }
+  return steady;
+}
+
+
+void steadyStatePrint(FILE *fp, const steadyStateType *s, const double elapsed) {
+  if (s->window == 0) return;
+  if (s->reached) {
+    fprintf(fp, "*info* steady state after %.0lf s (window %zd s)", s->reachedAt, s->window);
+  } else {
+    fprintf(fp, "*warning* steady state NOT reached in %.0lf s (window %zd s)", elapsed, s->window);
+  }
+  for (size_t m = 0; m < STEADYMETRICS; m++) {
+    const double mean = s->mean[m];
+    fprintf(fp, ", %s excursion %.1lf%% slope %.1lf%%", steadyNames[m], mean > 0 ? 100 * s->excursion[m] / mean : 0, mean > 0 ? 100 * s->slope[m] / mean : 0);
+  }
+  fprintf(fp, "\n");
+}
+
+
+void steadyStateJSON(FILE *fp, const steadyStateType *s) {
+  fprintf(fp, "{\"window\": %zd, \"maxExcursion\": %.3lf, \"maxSlope\": %.3lf, \"reached\": %s, \"reachedAt\": %.1lf, \"samples\": %zd",
+	  s->window, s->maxExcursion, s->maxSlope, s->reached ? "true" : "false", s->reachedAt, s->count);
+  for (size_t m = 0; m < STEADYMETRICS; m++) {
+    fprintf(fp, ", \"%s\": {\"mean\": %.6lf, \"excursion\": %.6lf, \"slope\": %.6lf}", steadyNames[m], s->mean[m], s->excursion[m], s->slope[m]);
+  }
+  fprintf(fp, "}");
+}
+
+
+void steadyStateFree(steadyStateType *s) {
+  for (size_t m = 0; m < STEADYMETRICS; m++) {
+    free(s->samples[m]);
+    s->samples[m] = NULL;
+  }
+}
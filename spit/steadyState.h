@@ -0,0 +1,36 @@
+#ifndef _STEADYSTATE_H
+#define _STEADYSTATE_H
+
+#include <stdio.h>
+
+/*
+ * SNIA PTS style steady state over a rolling window of per second samples.
+ * A metric is steady when, over the window, the range of the samples is
+ * within the excursion and the range of their least squares line is
+ * within the slope, both as fractions of the window's mean.
+ */
+#define STEADYMETRICS 2
+#define STEADYIOPS 0
+#define STEADYLATENCY 1
+
+typedef struct {
+  size_t window;          // samples (seconds), 0 if not enabled
+  double maxExcursion;    // fraction of the mean, 0.2 in the PTS
+  double maxSlope;        // fraction of the mean, 0.1 in the PTS
+  double *samples[STEADYMETRICS]; // ring buffers of window samples
+  size_t count;
+  int reached;
+  double reachedAt;       // seconds into the run
+  double mean[STEADYMETRICS];     // of the last full window
+  double excursion[STEADYMETRICS];
+  double slope[STEADYMETRICS];
+} steadyStateType;
+
+int  steadyStateParse(const char *spec, size_t *window, double *maxExcursion, double *maxSlope);
+void steadyStateInit(steadyStateType *s, const size_t window, const double maxExcursion, const double maxSlope);
+int  steadyStateAdd(steadyStateType *s, const double elapsed, const double iops, const double latency);
+void steadyStatePrint(FILE *fp, const steadyStateType *s, const double elapsed);
+void steadyStateJSON(FILE *fp, const steadyStateType *s);
+void steadyStateFree(steadyStateType *s);
+
+#endif
@@ -0,0 +1,96 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "stripe.h"
+#include "utils.h"
+
+// returns 0 if all the members are open, if not the ones that opened are closed
+int stripeOpen(stripeType *s, char **devices, const size_t count, const size_t chunk, const int flags) {
+  memset(s, 0, sizeof(stripeType));
+  s->count = count;
+  s->chunk = chunk;
+  CALLOC(s->fds, count, sizeof(int));
+  CALLOC(s->readBytes, count, sizeof(size_t));
+  CALLOC(s->readIOs, count, sizeof(size_t));
+  CALLOC(s->writtenBytes, count, sizeof(size_t));
+  CALLOC(s->writtenIOs, count, sizeof(size_t));
+
+  int failed = 0;
+  for (size_t i = 0; i < count; i++) {
+    s->fds[i] = open(devices[i], flags);
+    if (s->fds[i] < 0) {
+      perror(devices[i]);
+      failed = 1;
+    }
+  }
+  if (failed) { // none are left open
+    stripeClose(s);
+  }
+  return failed;
+}
+
+
+// the usable size of the striped device, whole chunks of the smallest member
+size_t stripeSize(const size_t deviceSize, const size_t count, const size_t chunk) {
+  return (deviceSize / chunk) * chunk * count;
+}
+
+
+/* point an iocb at the member and its offset. The positions of a striped
+ * job are made so none cross the end of a chunk (setupPositions' boundary) */
+void stripeMap(stripeType *s, struct iocb *cb) {
+  const size_t len = cb->u.c.nbytes;
+  const size_t chunkNo = cb->u.c.offset / s->chunk;
+  const size_t within = cb->u.c.offset % s->chunk;
+  assert(within + len <= s->chunk);
+  const size_t member = chunkNo % s->count;
+
+  cb->aio_fildes = s->fds[member];
+  cb->u.c.offset = (chunkNo / s->count) * s->chunk + within;
+  if (cb->aio_lio_opcode == IO_CMD_PREAD) {
+    s->readBytes[member] += len;
+    s->readIOs[member]++;
+  } else {
+    s->writtenBytes[member] += len;
+    s->writtenIOs[member]++;
+  }
+}
+
+
+void stripeResetStats(stripeType *s) {
+  for (size_t i = 0; i < s->count; i++) {
+    s->readBytes[i] = 0;
+    s->readIOs[i] = 0;
+    s->writtenBytes[i] = 0;
+    s->writtenIOs[i] = 0;
+  }
+}
+
+
+int stripeFlush(const stripeType *s) {
+  int ret = 0;
+  for (size_t i = 0; i < s->count; i++) {
+    if (fsync(s->fds[i]) != 0) ret = -1;
+  }
+  return ret;
+}
+
+
+void stripeClose(stripeType *s) {
+  for (size_t i = 0; i < s->count; i++) {
+    if (s->fds[i] >= 0) close(s->fds[i]);
+  }
+  free(s->fds);
+  free(s->readBytes);
+  free(s->readIOs);
+  free(s->writtenBytes);
+  free(s->writtenIOs);
+  memset(s, 0, sizeof(stripeType));
+}
@@ -0,0 +1,24 @@
+#ifndef _STRIPE_H
+#define _STRIPE_H
+
+#include <libaio.h>
+
+// one job spread over several devices, chunk bytes on each in turn
+typedef struct {
+  size_t count;
+  size_t chunk;
+  int *fds;
+  size_t *readBytes;      // per member, for the reports
+  size_t *readIOs;
+  size_t *writtenBytes;
+  size_t *writtenIOs;
+} stripeType;
+
+int    stripeOpen(stripeType *s, char **devices, const size_t count, const size_t chunk, const int flags);
+size_t stripeSize(const size_t deviceSize, const size_t count, const size_t chunk);
+void   stripeMap(stripeType *s, struct iocb *cb);
+void   stripeResetStats(stripeType *s);
+int    stripeFlush(const stripeType *s);
+void   stripeClose(stripeType *s);
+
+#endif
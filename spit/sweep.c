@@ -0,0 +1,317 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sweep.h"
+#include "results.h"
+#include "utils.h"
+
+/**
+ * sweep.c
+ *
+ * --sweep runs every combination of block size, QD, read/write ratio,
+ * sequential streams and number of jobs in the one process. QD is the
+ * inner loop so a cell that only changes the QD reuses the positions
+ * of the previous cell
+ *
+ */
+
+extern volatile int keepRunning;
+
+static const char *sweepKeys[SWEEPDIMS] = {"k", "q", "rw", "s", "j"};
+static const char *sweepNames[SWEEPDIMS] = {"blockSizeKiB", "queueDepth", "readRatio", "seqFiles", "jobs"};
+
+
+// returns 0 if ok, otherwise prints the problem and returns 1
+int sweepParse(sweepType *s, const char *spec) {
+  memset(s, 0, sizeof(sweepType));
+
+  char *copy = strdup(spec), *saveptr = NULL;
+  int bad = 0;
+  for (char *tok = strtok_r(copy, " ;", &saveptr); tok && !bad; tok = strtok_r(NULL, " ;", &saveptr)) {
+    char *values = strchr(tok, '=');
+    if (!values) {
+      bad = 1; break;
+    }
+    *(values++) = 0;
+
+    int d = -1;
+    for (size_t k = 0; k < SWEEPDIMS; k++) {
+      if (strcmp(tok, sweepKeys[k]) == 0) d = k;
+    }
+    if (d < 0 || s->dim[d].count) {
+      bad = 1; break;
+    }
+
+    char *saveptr2 = NULL;
+    for (char *v = strtok_r(values, ",", &saveptr2); v; v = strtok_r(NULL, ",", &saveptr2)) {
+      const double value = atof(v);
+      if ((d == SWEEPRW && (value < 0 || value > 1)) || (d != SWEEPRW && d != SWEEPSEQ && value <= 0) || (d == SWEEPSEQ && value < 0)) {
+	fprintf(stderr,"*error* sweep value %s=%s is out of range\n", tok, v);
+	bad = 1; break;
+      }
+      s->dim[d].values = realloc(s->dim[d].values, (s->dim[d].count + 1) * sizeof(double));
+      s->dim[d].values[s->dim[d].count++] = value;
+    }
+  }
+  free(copy);
+
+  if (bad) {
+    fprintf(stderr,"*error* can't parse --sweep '%s', e.g. \"k=4,64 q=1,32 rw=1,0.5,0 s=0,1 j=1,4\"\n", spec);
+  }
+  return bad;
+}
+
+
+size_t sweepCells(const sweepType *s) {
+  size_t cells = 1;
+  for (size_t d = 0; d < SWEEPDIMS; d++) {
+    if (s->dim[d].count) cells *= s->dim[d].count;
+  }
+  return cells;
+}
+
+
+void sweepFree(sweepType *s) {
+  for (size_t d = 0; d < SWEEPDIMS; d++) {
+    free(s->dim[d].values);
+    s->dim[d].values = NULL;
+    s->dim[d].count = 0;
+  }
+}
+
+
+static size_t gcd(size_t a, size_t b) {
+  while (b) {
+    const size_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* the job string of a cell, the swept values go first so they win over the
+ * template's. The R/W ratio is to the nearest 0.1 as r/w character counts */
+static char *sweepJobString(const sweepType *s, const double *v, const char *template, const int withQD) {
+  char *str = malloc(strlen(template) + 100), *p = str;
+  const int sweepRW = (s->dim[SWEEPRW].count > 0);
+
+  if (sweepRW) {
+    size_t r = (size_t) (v[SWEEPRW] * 10 + 0.5), w = 10 - r;
+    const size_t g = gcd(r, w);
+    r /= g;
+    w /= g;
+    for (size_t i = 0; i < r; i++) *(p++) = 'r';
+    for (size_t i = 0; i < w; i++) *(p++) = 'w';
+  }
+  if (s->dim[SWEEPBS].count) p += sprintf(p, "k%g", v[SWEEPBS]);
+  if (withQD && s->dim[SWEEPQD].count) p += sprintf(p, "q%.0lf", v[SWEEPQD]);
+  if (s->dim[SWEEPSEQ].count) p += sprintf(p, "s%.0lf", v[SWEEPSEQ]);
+
+  for (const char *t = template; *t; t++) {
+    if (sweepRW && (*t == 'r' || *t == 'w')) continue;
+    *(p++) = *t;
+  }
+  *p = 0;
+  return str;
+}
+
+
+static void sweepAddTotals(sweepCellType *cell, const threadInfoType *tc, const size_t num) {
+  positionContainerInit(&cell->total, 0);
+  cell->elapsed = 0;
+  for (size_t i = 0; i < num; i++) {
+    const positionContainer *pc = &tc[i].pos;
+    cell->total.readBytes += pc->readBytes;
+    cell->total.readIOs += pc->readIOs;
+    cell->total.writtenBytes += pc->writtenBytes;
+    cell->total.writtenIOs += pc->writtenIOs;
+    histogramMerge(&cell->total.readLatency, &pc->readLatency);
+    histogramMerge(&cell->total.writeLatency, &pc->writeLatency);
+    histogramMerge(&cell->total.flushLatency, &pc->flushLatency);
+    cell->total.cpuUser += pc->cpuUser;
+    cell->total.cpuSys += pc->cpuSys;
+    cell->total.ctxVoluntary += pc->ctxVoluntary;
+    cell->total.ctxInvoluntary += pc->ctxInvoluntary;
+    if (pc->elapsedTime > cell->elapsed) cell->elapsed = pc->elapsedTime;
+  }
+}
+
+
+static void sweepPrintTable(FILE *fp, const sweepType *s, const sweepCellType *cells, const size_t numCells) {
+  fprintf(fp, "%8s %6s %5s %5s %4s %10s %10s %10s %10s %9s %9s %9s %9s %8s  %s\n", "k", "qd", "R/W", "s", "j", "readMiBs", "readIOPS", "writeMiBs", "writeIOPS", "rP50us", "rP99us", "wP50us", "wP99us", "cpuus/IO", "job");
+  for (size_t c = 0; c < numCells; c++) {
+    const sweepCellType *cell = &cells[c];
+    const positionContainer *t = &cell->total;
+    const double e = (cell->elapsed > 0) ? cell->elapsed : 1;
+    const size_t ios = t->readIOs + t->writtenIOs;
+    char v[SWEEPDIMS][20];
+    for (size_t d = 0; d < SWEEPDIMS; d++) {
+      if (s->dim[d].count) snprintf(v[d], 20, "%g", cell->value[d]);
+      else strcpy(v[d], "-");
+    }
+    fprintf(fp, "%8s %6s %5s %5s %4zd %10.1lf %10.0lf %10.1lf %10.0lf %9.0lf %9.0lf %9.0lf %9.0lf %8.2lf  %s\n",
+	    v[SWEEPBS], v[SWEEPQD], v[SWEEPRW], v[SWEEPSEQ], cell->jobs,
+	    TOMiB(t->readBytes) / e, t->readIOs / e, TOMiB(t->writtenBytes) / e, t->writtenIOs / e,
+	    histogramPercentile(&t->readLatency, 50) * 1000000, histogramPercentile(&t->readLatency, 99) * 1000000,
+	    histogramPercentile(&t->writeLatency, 50) * 1000000, histogramPercentile(&t->writeLatency, 99) * 1000000,
+	    ios ? (t->cpuUser + t->cpuSys) * 1000000 / ios : 0, cell->jobstring);
+  }
+}
+
+
+static int sweepWriteJSON(const char *fn, const sweepType *s, const sweepCellType *cells, const size_t numCells, const size_t timetorun, const jobOptionsType *options) {
+  FILE *fp = fopen(fn, "wt");
+  if (!fp) {
+    perror(fn); return 1;
+  }
+  fprintf(fp, "{\n  \"commandLine\": ");
+  resultsJSONString(fp, options->commandLine);
+  fprintf(fp, ",\n  \"warmup\": %zd,\n  \"duration\": %zd,\n  \"sweep\": {", s->warmup, timetorun);
+  size_t printed = 0;
+  for (size_t d = 0; d < SWEEPDIMS; d++) {
+    if (!s->dim[d].count) continue;
+    fprintf(fp, "%s\"%s\": [", printed++ ? ", " : "", sweepNames[d]);
+    for (size_t k = 0; k < s->dim[d].count; k++) {
+      fprintf(fp, "%s%g", k ? ", " : "", s->dim[d].values[k]);
+    }
+    fprintf(fp, "]");
+  }
+  fprintf(fp, "},\n  \"cells\": [\n");
+
+  for (size_t c = 0; c < numCells; c++) {
+    const sweepCellType *cell = &cells[c];
+    fprintf(fp, "    {\"job\": ");
+    resultsJSONString(fp, cell->jobstring);
+    fprintf(fp, ", \"jobs\": %zd, \"reusedPositions\": %d", cell->jobs, cell->reusedPositions);
+    for (size_t d = 0; d < SWEEPDIMS; d++) {
+      if (s->dim[d].count && d != SWEEPJOBS) fprintf(fp, ", \"%s\": %g", sweepNames[d], cell->value[d]);
+    }
+    if (cell->steady.window) {
+      fprintf(fp, ",\n     \"steadyState\": ");
+      steadyStateJSON(fp, &cell->steady);
+    }
+    fprintf(fp, ",\n     \"throughput\": {");
+    resultsThroughputJSON(fp, &cell->total, cell->elapsed);
+    fprintf(fp, "},\n     \"readLatency\": ");
+    resultsLatencyJSON(fp, &cell->total.readLatency);
+    fprintf(fp, ",\n     \"writeLatency\": ");
+    resultsLatencyJSON(fp, &cell->total.writeLatency);
+    fprintf(fp, ",\n     \"cpu\": ");
+    resultsCPUJSON(fp, &cell->total);
+    fprintf(fp, "}%s\n", (c < numCells - 1) ? "," : "");
+  }
+  fprintf(fp, "  ]\n}\n");
+  fclose(fp);
+  fprintf(stderr,"*info* sweep results written to '%s'\n", fn);
+  return 0;
+}
+
+
+void sweepRun(const sweepType *s, const char *template, const size_t defaultJobs, const size_t maxSizeInBytes, const size_t timetorun, const jobOptionsType *options) {
+  const size_t numCells = sweepCells(s);
+  sweepCellType *cells;
+  CALLOC(cells, numCells, sizeof(sweepCellType));
+
+  fprintf(stderr,"*info* sweep of %zd cells, %zd s warm-up + %zd s each, about %.0lf minutes\n", numCells, s->warmup, timetorun, numCells * (s->warmup + timetorun) / 60.0);
+
+  threadInfoType *tc = NULL;
+  jobType setupJob;
+  char *setupKey = NULL;
+  size_t setupJobs = 0, setupCellJobs = 0, done = 0; // threads, and the cell's jobs before the devices
+  int preconditioned = 0;
+
+  // the odometer over the swept values, the last dimension (jobs) is the outermost
+  size_t index[SWEEPDIMS] = {0};
+  const int order[SWEEPDIMS] = {SWEEPQD, SWEEPBS, SWEEPRW, SWEEPSEQ, SWEEPJOBS};
+
+  for (size_t c = 0; c < numCells && keepRunning; c++) {
+    sweepCellType *cell = &cells[c];
+    for (size_t d = 0; d < SWEEPDIMS; d++) {
+      cell->value[d] = s->dim[d].count ? s->dim[d].values[index[d]] : 0;
+    }
+    cell->jobs = s->dim[SWEEPJOBS].count ? (size_t)cell->value[SWEEPJOBS] : defaultJobs;
+    cell->jobstring = sweepJobString(s, cell->value, template, 1);
+    char *key = sweepJobString(s, cell->value, template, 0);
+
+    fprintf(stderr,"*info* sweep cell %zd/%zd: '%s' x %zd\n", c + 1, numCells, cell->jobstring, cell->jobs);
+
+    if (tc && setupCellJobs == cell->jobs && strcmp(key, setupKey) == 0) {
+      // same positions, only the QD differs
+      for (size_t i = 0; i < setupJobs; i++) {
+	size_t qd = s->dim[SWEEPQD].count ? (size_t)cell->value[SWEEPQD] : tc[i].queueDepth;
+	const size_t limit = tc[i].random ? tc[i].random : tc[i].pos.sz;
+	if (qd > limit) qd = limit;
+	tc[i].queueDepth = qd;
+	tc[i].jobstring = cell->jobstring;
+      }
+      cell->reusedPositions = 1;
+      free(key);
+    } else {
+      if (tc) {
+	jobFreeThreads(tc, setupJobs);
+	jobFree(&setupJob);
+	free(setupKey);
+      }
+      jobInit(&setupJob);
+      jobAdd(&setupJob, cell->jobstring);
+      jobAssignDevices(&setupJob, options);
+      if (cell->jobs > 1) {
+	jobMultiply(&setupJob, cell->jobs - 1);
+      }
+      setupJobs = setupJob.count;
+      setupCellJobs = cell->jobs;
+      tc = jobSetupThreads(&setupJob, setupJobs, maxSizeInBytes, s->warmup + timetorun, 0, options);
+      if (!preconditioned) {
+	resultsTimingType timing;
+	if (jobPrecondition(tc, setupJobs, &timing)) {
+	  break;
+	}
+	preconditioned = 1;
+      }
+      setupKey = key;
+    }
+
+    resultsTimingType timing;
+    if (s->warmup) {
+      fprintf(stderr,"*info* warming up for %zd s\n", s->warmup);
+      jobRunPrepared(tc, setupJobs, s->warmup, &timing);
+    }
+    if (keepRunning) {
+      jobRunPrepared(tc, setupJobs, timetorun, &timing);
+      sweepAddTotals(cell, tc, setupJobs);
+      cell->steady = timing.steady;
+      done++;
+    }
+
+    // the next combination
+    for (size_t o = 0; o < SWEEPDIMS; o++) {
+      const int d = order[o];
+      if (!s->dim[d].count) continue;
+      if (++index[d] < s->dim[d].count) break;
+      index[d] = 0;
+    }
+  }
+
+  if (tc) {
+    jobFreeThreads(tc, setupJobs);
+    jobFree(&setupJob);
+    free(setupKey);
+  }
+
+  if (done < numCells) {
+    fprintf(stderr,"*warning* sweep stopped after %zd of %zd cells\n", done, numCells);
+  }
+  sweepPrintTable(stdout, s, cells, done);
+  if (options->resultsFilename) {
+    sweepWriteJSON(options->resultsFilename, s, cells, done, timetorun, options);
+  }
+
+  for (size_t c = 0; c < numCells; c++) {
+    free(cells[c].jobstring);
+  }
+  free(cells);
+}
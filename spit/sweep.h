@@ -0,0 +1,40 @@
+#ifndef _SWEEP_H
+#define _SWEEP_H
+
+#include "jobType.h"
+
+// the dimensions of a --sweep, e.g. "k=4,64 q=1,32 rw=1,0.5,0 s=0,1 j=1,4"
+#define SWEEPBS 0
+#define SWEEPQD 1
+#define SWEEPRW 2
+#define SWEEPSEQ 3
+#define SWEEPJOBS 4
+#define SWEEPDIMS 5
+
+typedef struct {
+  size_t count;            // 0 if not swept, the job string's value is used
+  double *values;
+} sweepDimType;
+
+typedef struct {
+  sweepDimType dim[SWEEPDIMS];
+  size_t warmup;           // seconds run before each cell is measured
+} sweepType;
+
+// the parameters and aggregate results of one combination
+typedef struct {
+  double value[SWEEPDIMS];
+  char *jobstring;
+  size_t jobs;
+  int reusedPositions;
+  positionContainer total;
+  double elapsed;
+  steadyStateType steady;  // of the measured run, with -S
+} sweepCellType;
+
+int  sweepParse(sweepType *s, const char *spec);
+size_t sweepCells(const sweepType *s);
+void sweepRun(const sweepType *s, const char *template, const size_t defaultJobs, const size_t maxSizeInBytes, const size_t timetorun, const jobOptionsType *options);
+void sweepFree(sweepType *s);
+
+#endif
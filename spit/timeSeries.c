@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "timeSeries.h"
+#include "utils.h"
+
+#define TIMESERIESBUFFER (1024*1024)
+
+/* prefix "ts" is ts-000.csv, "ts.ndjson" is ts-000.ndjson. The format is
+ * taken from the extension, CSV is the default */
+char *timeSeriesFilename(const char *prefix, const size_t id, int *format) {
+  const char *slash = strrchr(prefix, '/');
+  const char *dot = strrchr(prefix, '.');
+  if (dot && slash && dot < slash) dot = NULL;
+
+  *format = TIMESERIESCSV;
+  size_t baselen = strlen(prefix);
+  if (dot) {
+    if (strcmp(dot, ".ndjson") == 0 || strcmp(dot, ".json") == 0) {
+      *format = TIMESERIESNDJSON;
+      baselen = dot - prefix;
+    } else if (strcmp(dot, ".csv") == 0) {
+      baselen = dot - prefix;
+    }
+  }
+
+  char *fn = NULL;
+  CALLOC(fn, baselen + 20, 1);
+  memcpy(fn, prefix, baselen);
+  sprintf(fn + baselen, "-%03zd.%s", id, (*format == TIMESERIESNDJSON) ? "ndjson" : "csv");
+  return fn;
+}
+
+
+int timeSeriesOpen(timeSeriesType *t, const char *prefix, const size_t id) {
+  memset(t, 0, sizeof(timeSeriesType));
+  t->id = id;
+
+  char *fn = timeSeriesFilename(prefix, id, &t->format);
+  t->fp = fopen(fn, "wt");
+  if (!t->fp) {
+    perror(fn); free(fn); return 1;
+  }
+  // one large buffer so a sample is a memcpy, not a write()
+  setvbuf(t->fp, NULL, _IOFBF, TIMESERIESBUFFER);
+  fprintf(stderr,"*info* writing time series for job %zd to '%s'\n", id, fn);
+  free(fn);
+
+  if (t->format == TIMESERIESCSV) {
+    fprintf(t->fp, "time,interval,readMiBs,readIOPS,writeMiBs,writeIOPS,readMeanus,readP99us,writeMeanus,writeP99us,inFlight,cpuus,cpuusPerIO,cpuusPerMiB\n");
+  }
+  return 0;
+}
+
+
+// append the values since the last call, period is the seconds since the last call
+void timeSeriesAdd(timeSeriesType *t, const positionContainer *pc, const double elapsed, const double period) {
+  if (!t->fp || period <= 0) {
+    return;
+  }
+
+  const size_t rb = pc->readBytes, wb = pc->writtenBytes, ri = pc->readIOs, wi = pc->writtenIOs;
+  const double readMiBs = TOMiB(rb - t->lastReadBytes) / period;
+  const double writeMiBs = TOMiB(wb - t->lastWrittenBytes) / period;
+  const double readIOPS = (ri - t->lastReadIOs) / period;
+  const double writeIOPS = (wi - t->lastWrittenIOs) / period;
+
+  // one copy of each histogram, the jobs are still adding to them
+  histogramType snap;
+  memcpy(&snap, &pc->readLatency, sizeof(histogramType));
+  histogramDelta(&t->delta, &snap, &t->lastRead);
+  memcpy(&t->lastRead, &snap, sizeof(histogramType));
+  const double readMean = histogramMean(&t->delta) * 1000000.0, readP99 = histogramPercentile(&t->delta, 99) * 1000000.0;
+
+  memcpy(&snap, &pc->writeLatency, sizeof(histogramType));
+  histogramDelta(&t->delta, &snap, &t->lastWrite);
+  memcpy(&t->lastWrite, &snap, sizeof(histogramType));
+  const double writeMean = histogramMean(&t->delta) * 1000000.0, writeP99 = histogramPercentile(&t->delta, 99) * 1000000.0;
+
+  // CPU of the job thread in the interval, its last value once the thread has gone
+  const double now = pc->cpuClockValid ? threadCPUTime(pc->cpuClock) : pc->cpuClockLast;
+  const double cpu = (now > 0) ? now : t->lastCPU;
+  const double cpuus = (cpu - t->lastCPU) * 1000000.0;
+  const size_t ios = (ri - t->lastReadIOs) + (wi - t->lastWrittenIOs);
+  const double MiB = TOMiB((rb - t->lastReadBytes) + (wb - t->lastWrittenBytes));
+  const double cpuPerIO = ios ? cpuus / ios : 0, cpuPerMiB = (MiB > 0) ? cpuus / MiB : 0;
+
+  if (t->format == TIMESERIESNDJSON) {
+    fprintf(t->fp, "{\"time\":%.3lf, \"interval\":%.3lf, \"job\":%zd, \"readMiBs\":%.2lf, \"readIOPS\":%.0lf, \"writeMiBs\":%.2lf, \"writeIOPS\":%.0lf, \"readMeanus\":%.0lf, \"readP99us\":%.0lf, \"writeMeanus\":%.0lf, \"writeP99us\":%.0lf, \"inFlight\":%zd, \"cpuus\":%.0lf, \"cpuusPerIO\":%.2lf, \"cpuusPerMiB\":%.1lf}\n", elapsed, period, t->id, readMiBs, readIOPS, writeMiBs, writeIOPS, readMean, readP99, writeMean, writeP99, pc->inFlight, cpuus, cpuPerIO, cpuPerMiB);
+  } else {
+    fprintf(t->fp, "%.3lf,%.3lf,%.2lf,%.0lf,%.2lf,%.0lf,%.0lf,%.0lf,%.0lf,%.0lf,%zd,%.0lf,%.2lf,%.1lf\n", elapsed, period, readMiBs, readIOPS, writeMiBs, writeIOPS, readMean, readP99, writeMean, writeP99, pc->inFlight, cpuus, cpuPerIO, cpuPerMiB);
+  }
+
+  t->lastReadBytes = rb;
+  t->lastWrittenBytes = wb;
+  t->lastReadIOs = ri;
+  t->lastWrittenIOs = wi;
+  t->lastCPU = cpu;
+}
+
+
+void timeSeriesClose(timeSeriesType *t) {
+  if (t->fp) {
+    fclose(t->fp);
+    t->fp = NULL;
+  }
+}
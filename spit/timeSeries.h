@@ -0,0 +1,32 @@
+#ifndef _TIMESERIES_H
+#define _TIMESERIES_H
+
+#include <stdio.h>
+
+#include "positions.h"
+#include "histogram.h"
+
+#define TIMESERIESCSV 1
+#define TIMESERIESNDJSON 2
+
+// the per job state to turn running totals into per interval values
+typedef struct {
+  FILE *fp;
+  int format;
+  size_t id;
+  size_t lastReadBytes;
+  size_t lastWrittenBytes;
+  size_t lastReadIOs;
+  size_t lastWrittenIOs;
+  double lastCPU;
+  histogramType lastRead;
+  histogramType lastWrite;
+  histogramType delta;
+} timeSeriesType;
+
+char *timeSeriesFilename(const char *prefix, const size_t id, int *format);
+int  timeSeriesOpen(timeSeriesType *t, const char *prefix, const size_t id);
+void timeSeriesAdd(timeSeriesType *t, const positionContainer *pc, const double elapsed, const double period);
+void timeSeriesClose(timeSeriesType *t);
+
+#endif
@@ -17,6 +17,7 @@
 #include <limits.h>
 #include <unistd.h>
 #include <sys/sysinfo.h>
+#include <sys/resource.h>
 #include <sys/utsname.h>
 #include <sys/types.h>
 #include <pwd.h>
@@ -301,6 +302,28 @@ void checkContents(char *label, char *charbuf, size_t size, const size_t checksu
 }
 
 
+// CPU seconds and context switches of the calling thread
+void threadCPUUsage(double *user, double *sys, size_t *voluntary, size_t *involuntary) {
+  struct rusage r;
+  if (getrusage(RUSAGE_THREAD, &r) != 0) {
+    memset(&r, 0, sizeof(struct rusage));
+  }
+  *user = r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1000000.0;
+  *sys = r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1000000.0;
+  *voluntary = r.ru_nvcsw;
+  *involuntary = r.ru_nivcsw;
+}
+
+// CPU seconds (user + sys) of a thread, from pthread_getcpuclockid()
+double threadCPUTime(const clockid_t clock) {
+  struct timespec ts;
+  if (clock_gettime(clock, &ts) != 0) {
+    return 0;
+  }
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
 size_t numThreads() {
   return sysconf(_SC_NPROCESSORS_ONLN);
 }
@@ -338,11 +361,12 @@ void generateRandomBufferCyclic(char *buffer, size_t size, unsigned short seed,
     //fprintf(stderr,"*info* generating a random buffer with a size %zd bytes, cyclic %zd bytes\n", size, cyclic);
   }
   
-  srand48(seed);
+  // the srand48(seed) state, but local, the verify jobs call this concurrently
+  unsigned short xsubi[3] = {0x330E, seed, 0};
   char *user = username();
 
-  const char verystartpoint = ' ' + (lrand48() % 30);
-  const char jump = (lrand48() % 3) + 1;
+  const char verystartpoint = ' ' + (nrand48(xsubi) % 30);
+  const char jump = (nrand48(xsubi) % 3) + 1;
   char startpoint = verystartpoint;
   for (size_t j = 0; j < cyclic; j++) {
     buffer[j] = startpoint;
@@ -507,6 +531,7 @@ int canOpenExclusively(const char *fn) {
   return 1;
 }
 
+// allocate with fallocate, or write zeros if the filesystem can't
 int createFile(const char *filename, const size_t sz) {
   assert(sz);
 
@@ -527,17 +552,32 @@ int createFile(const char *filename, const size_t sz) {
     }
   }
 
+  const double start = timedouble();
+  if (fallocate(fd, 0, 0, sz) == 0) {
+    fprintf(stderr,"*info* allocated '%s' in %.2lf s\n", filename, timedouble() - start);
+    close(fd);
+    return 0;
+  }
+  fprintf(stderr,"*warning* fallocate of '%s' failed (%s), writing zeros\n", filename, strerror(errno));
+
   char *buf = NULL;
   CALLOC(buf, 1, 1024*1024);
   
   size_t towriteMiB = sz;
+  double last = start;
   while (towriteMiB > 0 && keepRunning) {
     int towrite = MIN(towriteMiB, 1024*1024);
     int wrote = write(fd, buf, towrite);
     if (wrote < 0) {
-      perror("createFile");free(buf);return 1;
+      perror("createFile");free(buf);close(fd);return 1;
     }
     towriteMiB -= towrite;
+    const double now = timedouble();
+    if (now - last >= 1) {
+      const double rate = (sz - towriteMiB) / (now - start);
+      fprintf(stderr,"*info* creating '%s': %.1lf%%, %.0lf MiB/s, ETA %.0lf s\n", filename, 100.0 * (sz - towriteMiB) / sz, TOMiB(rate), towriteMiB / rate);
+      last = now;
+    }
   }
   fsync(fd);
   close(fd);
@@ -564,3 +604,18 @@ void commaPrint0dp(FILE *fp, double d) {
     fprintf(fp,"%7.0lf", d);
   }
 }
+
+/* creates a new string, the arguments joined by spaces */
+char *commandLine(const int argc, char *argv[]) {
+  size_t len = 1;
+  for (int i = 0; i < argc; i++) {
+    len += strlen(argv[i]) + 1;
+  }
+  char *s = NULL;
+  CALLOC(s, len, 1);
+  for (int i = 0; i < argc; i++) {
+    if (i) strcat(s, " ");
+    strcat(s, argv[i]);
+  }
+  return s;
+}
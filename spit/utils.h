@@ -3,6 +3,7 @@
 
 #include <malloc.h>
 #include <string.h>
+#include <time.h>
 
 #include "logSpeed.h"
 
@@ -43,6 +44,8 @@ size_t numThreads();
 size_t totalRAM();
 char *OSRelease();
 size_t swapTotal();
+void threadCPUUsage(double *user, double *sys, size_t *voluntary, size_t *involuntary);
+double threadCPUTime(const clockid_t clock);
 
 size_t fileSize(int fd);
 size_t fileSizeFromName(const char *path);
@@ -70,6 +73,7 @@ int startsWith(const char *pre, const char *str);
 int canOpenExclusively(const char *fn);
 int createFile(const char *filename, const size_t sz);
 void commaPrint0dp(FILE *fp, double d);
+char *commandLine(const int argc, char *argv[]);
 
 #endif
 
@@ -13,13 +13,169 @@
  */
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
 
 #include "positions.h"
+#include "positionLog.h"
+#include "ioEngine.h"
 #include "utils.h"
   
 int verbose = 1;
 int keepRunning = 1;
 size_t waitEvery = 0;    
+
+// a write to check, sorted by offset then by where it was in the log
+typedef struct {
+  size_t pos;
+  size_t index;
+  unsigned int len;
+  unsigned short seed;
+} verifyItemType;
+
+// a thread checking a range of the sorted writes at a queue depth
+typedef struct {
+  const char *device;
+  size_t bdSize;
+  size_t QD;
+  size_t maxbs;
+  const verifyItemType *items;
+  size_t num;
+  volatile size_t done;     // read by the progress lines
+  volatile size_t bytes;
+  size_t correct, incorrect, wrongpos, ioErrors;
+  volatile int finished;
+} verifyJobType;
+
+static volatile size_t printed = 0; // the mismatches shown, over all the jobs
+
+static int verifyItemCompare(const void *p1, const void *p2) {
+  const verifyItemType *a = (const verifyItemType*)p1;
+  const verifyItemType *b = (const verifyItemType*)p2;
+  if (a->pos != b->pos) return (a->pos < b->pos) ? -1 : 1;
+  if (a->index != b->index) return (a->index < b->index) ? -1 : 1;
+  return 0;
+}
+
+static void verifyCheck(verifyJobType *j, const verifyItemType *item, const char *block, const char *expected) {
+  positionType pt;
+  memset(&pt, 0, sizeof(positionType));
+  pt.pos = item->pos;
+  pt.len = item->len;
+  size_t p;
+  memcpy(&p, block, sizeof(size_t));
+  const int v = positionVerifyBlock(&pt, block, expected);
+  if (v == 0) {
+    j->correct++;
+  } else if (v == 1) {
+    if (__atomic_fetch_add(&printed, 1, __ATOMIC_RELAXED) <= 10)
+      fprintf(stderr,"position %zd had incorrect stored position of %zd\n", item->pos, p);
+    j->wrongpos++;
+  } else {
+    if (__atomic_fetch_add(&printed, 1, __ATOMIC_RELAXED) <= 10)
+      fprintf(stderr,"[%zd, %zd (len %d)]\n1: %s\n2: %s\n", p, item->pos, item->len, block+16, expected+16);
+    j->incorrect++;
+  }
+}
+
+static void *verifyJob(void *arg) {
+  verifyJobType *j = (verifyJobType*)arg;
+  const size_t QD = j->QD;
+
+  int fd = open(j->device, O_RDONLY | O_DIRECT);
+  if (fd < 0) {
+    fd = open(j->device, O_RDONLY);
+  }
+  if (fd < 0) {perror(j->device);exit(-2);}
+  ioEngineType e;
+  if (ioEngineSetup(&e, IOENGINEAIO, QD, j->device, j->bdSize)) {
+    fprintf(stderr,"*error* io_setup failed with QD %zd\n", QD);
+    exit(-2);
+  }
+
+  // O_DIRECT reads need aligned buffers
+  const size_t slotSize = ((j->maxbs + 4095) / 4096) * 4096;
+  char *buffers, *expected;
+  struct iocb **cbs;
+  struct io_event *events;
+  size_t *freeSlots, *slotItem;
+  CALLOC(buffers, QD, slotSize);
+  CALLOC(expected, j->maxbs + 1, 1);
+  CALLOC(cbs, QD, sizeof(struct iocb*));
+  CALLOC(events, QD, sizeof(struct io_event));
+  CALLOC(freeSlots, QD, sizeof(size_t));
+  CALLOC(slotItem, QD, sizeof(size_t));
+  for (size_t q = 0; q < QD; q++) {
+    CALLOC(cbs[q], 1, sizeof(struct iocb));
+    freeSlots[q] = q;
+  }
+
+  size_t next = 0, inFlight = 0, numFree = QD;
+  unsigned short lastseed = 0;
+  int haveSeed = 0;
+
+  while (inFlight || next < j->num) {
+    while (numFree && next < j->num) {
+      const size_t slot = freeSlots[--numFree];
+      const verifyItemType *item = &j->items[next];
+      io_prep_pread(cbs[slot], fd, buffers + slot * slotSize, item->len, item->pos);
+      cbs[slot]->data = (void*)slot;
+      slotItem[slot] = next;
+      if (ioEngineSubmit(&e, cbs[slot]) != 1) {
+	perror("verify submit");
+	exit(-1);
+      }
+      inFlight++;
+      next++;
+    }
+
+    const int ret = ioEngineGetEvents(&e, 1, QD, events, NULL);
+    for (int k = 0; k < ret; k++) {
+      const size_t slot = (size_t)events[k].obj->data;
+      const verifyItemType *item = &j->items[slotItem[slot]];
+      if ((long)events[k].res != (long)item->len || events[k].res2 != 0) {
+	if (__atomic_fetch_add(&printed, 1, __ATOMIC_RELAXED) <= 10)
+	  fprintf(stderr,"*error* read of %u bytes at %zd returned %ld\n", item->len, item->pos, (long)events[k].res);
+	j->ioErrors++;
+      } else {
+	if (!haveSeed || item->seed != lastseed) {
+	  generateRandomBuffer(expected, j->maxbs, item->seed);
+	  lastseed = item->seed;
+	  haveSeed = 1;
+	}
+	verifyCheck(j, item, buffers + slot * slotSize, expected);
+      }
+      freeSlots[numFree++] = slot;
+      j->bytes += item->len;
+      j->done++;
+    }
+    if (ret > 0) inFlight -= ret;
+  }
+
+  for (size_t q = 0; q < QD; q++) {
+    free(cbs[q]);
+  }
+  free(cbs);
+  free(events);
+  free(freeSlots);
+  free(slotItem);
+  free(buffers);
+  free(expected);
+  ioEngineDestroy(&e);
+  close(fd);
+  j->finished = 1;
+  return NULL;
+}
+
+static void usage() {
+  fprintf(stderr,"Usage:\n  spitchecker [-q QD] [-j jobs] [positions file]   # verify the writes, stdin if there's no file\n");
+  fprintf(stderr,"  spitchecker -x [positions file]                 # export a binary position log as text\n");
+  fprintf(stderr,"\nOptions:\n");
+  fprintf(stderr,"  -q n   the reads in flight per job (default 64)\n");
+  fprintf(stderr,"  -j n   jobs, each checking its own range of the device (default 4)\n");
+}
+
 /**
  * main
  *
@@ -27,10 +183,52 @@ size_t waitEvery = 0;
 int main(int argc, char *argv[]) {
 
   // load in all the positions, generation from the -L filename option from aioRWTest
+  // spitchecker [-x] [-q QD] [-j jobs] [positions file], stdin if there's no file. -x exports a binary log as text
+
+  int exportText = 0, opt;
+  size_t QD = 64, numJobs = 4;
+  while ((opt = getopt(argc, argv, "xq:j:")) != -1) {
+    switch (opt) {
+    case 'x':
+      exportText = 1;
+      break;
+    case 'q':
+      QD = atoi(optarg);
+      if (QD < 1) QD = 1;
+      break;
+    case 'j':
+      numJobs = atoi(optarg);
+      if (numJobs < 1) numJobs = 1;
+      break;
+    default:
+      usage();
+      exit(-1);
+    }
+  }
+  const int argi = optind;
+  const char *fn = (argi < argc) ? argv[argi] : NULL;
+  int in = fn ? open(fn, O_RDONLY) : fileno(stdin);
+  if (in < 0) {perror(fn);exit(-2);}
 
   positionContainer pc;
-  
-  positionContainerLoad(&pc, stdin);
+
+  if (exportText) {
+    positionLogMapType m;
+    if (!positionLogIsBinary(in)) {
+      fprintf(stderr,"*error* -x needs a binary position log\n");
+      exit(-2);
+    }
+    if (positionLogMap(&m, in)) {
+      exit(-2);
+    }
+    positionLogExportText(stdout, &m);
+    positionLogUnmap(&m);
+    exit(0);
+  }
+  // text or binary, mmapped when it's a file
+  const double loadStart = timedouble();
+  positionContainerLoad(&pc, fn ? fdopen(in, "rt") : stdin);
+  fprintf(stderr,"*info* loaded %zd positions in %.2lf s\n", pc.sz, timedouble() - loadStart);
   positionContainerInfo(&pc);
 
   size_t sum = 0;
@@ -39,64 +237,84 @@ int main(int argc, char *argv[]) {
   }
   fprintf(stderr,"device covered %zd bytes (%.3lf GiB)\n", sum, TOGiB(sum));
 
-  char *loadblock= NULL;
-  char *buffer = NULL;
-  
-  CALLOC(buffer, pc.maxbs+1, 1);
-  CALLOC(loadblock, pc.maxbs+1, 1);
-
-
-  int fd = open(pc.device, O_RDONLY| O_DIRECT);
-  if (fd < 0) {perror(pc.device);exit(-2);}
-
-  size_t correct = 0, incorrect = 0;
-  unsigned short lastseed = 0;
-  size_t wrongpos = 0, wronguuid = 0;
-  size_t printed = 0;
-
-  size_t p;
-  
+  // the writes, sorted by offset so each job reads its range in order
+  verifyItemType *items;
+  CALLOC(items, pc.sz ? pc.sz : 1, sizeof(verifyItemType));
+  size_t numItems = 0, totalBytes = 0;
   for (size_t i = 0; i < pc.sz; i++) {
     if (pc.positions[i].action == 'W') {
-      //      fprintf(stderr,"[%zd] %zd %c %d\n", i, pc.positions[i].pos, pc.positions[i].action, pc.positions[i].seed);
-      lseek(fd, pc.positions[i].pos, SEEK_SET);
-      ssize_t ret = read(fd, loadblock, pc.positions[i].len);
-      if (ret != pc.positions[i].len) {perror("eerk");exit(-1);}
-
-      if (pc.positions[i].seed != lastseed || i==0) {
-	generateRandomBuffer(buffer, pc.maxbs, pc.positions[i].seed);
-	lastseed = pc.positions[i].seed;
-      }
-      // check position
-      memcpy(&p, loadblock, sizeof(size_t));
-      if (p != pc.positions[i].pos) {
-	if (printed++ <= 10) 
-	  fprintf(stderr,"position %zd had incorrect stored position of %zd\n", pc.positions[i].pos, p);
-	wrongpos++;
-	continue;
-      }
+      items[numItems].pos = pc.positions[i].pos;
+      items[numItems].index = i;
+      items[numItems].len = pc.positions[i].len;
+      items[numItems].seed = pc.positions[i].seed;
+      totalBytes += pc.positions[i].len;
+      numItems++;
+    }
+  }
+  qsort(items, numItems, sizeof(verifyItemType), verifyItemCompare);
 
-      if (strncmp((char*)(loadblock+16), (char*)(buffer+16), pc.positions[i].len - 16) == 0) {
-	correct++;
-      } else {
-	if (printed++ <= 10) 
-	  fprintf(stderr,"[%zd, %zd (len %d)]\n1: %s\n2: %s\n", p, pc.positions[i].pos, pc.positions[i].len, loadblock+16, buffer+16);
-	incorrect++;
-      }
+  if (numJobs > numItems) numJobs = numItems ? numItems : 1;
+  fprintf(stderr,"*info* verifying %zd writes (%.3lf GiB) of '%s', %zd job(s) at QD %zd\n", numItems, TOGiB(totalBytes), pc.device, numJobs, QD);
+
+  verifyJobType *jobs;
+  pthread_t *pt;
+  CALLOC(jobs, numJobs, sizeof(verifyJobType));
+  CALLOC(pt, numJobs, sizeof(pthread_t));
+  const double start = timedouble();
+  for (size_t i = 0; i < numJobs; i++) {
+    const size_t from = numItems * i / numJobs, to = numItems * (i + 1) / numJobs;
+    jobs[i].device = pc.device;
+    jobs[i].bdSize = pc.bdSize;
+    jobs[i].QD = QD;
+    jobs[i].maxbs = pc.maxbs;
+    jobs[i].items = items + from;
+    jobs[i].num = to - from;
+    pthread_create(&pt[i], NULL, verifyJob, &jobs[i]);
+  }
+
+  // progress every second until the jobs are done
+  double lastProgress = start;
+  for (;;) {
+    size_t finished = 0, done = 0, bytes = 0;
+    for (size_t i = 0; i < numJobs; i++) {
+      finished += jobs[i].finished;
+      done += jobs[i].done;
+      bytes += jobs[i].bytes;
+    }
+    if (finished == numJobs) break;
+    const double now = timedouble();
+    if (now - lastProgress >= 1) {
+      const double rate = bytes / (now - start);
+      const size_t eta = (rate > 0) ? (size_t)((totalBytes - bytes) / rate) : 0;
+      fprintf(stderr,"*info* verified %zd/%zd: %5.1lf%%, %.0lf MiB/s, ETA %zd:%02zd:%02zd\n", done, numItems, totalBytes ? 100.0 * bytes / totalBytes : 0, TOMiB(rate), eta / 3600, (eta / 60) % 60, eta % 60);
+      lastProgress = now;
     }
+    usleep(10000);
   }
 
-  close(fd);
+  size_t correct = 0, incorrect = 0, wrongpos = 0, wronguuid = 0, ioErrors = 0;
+  for (size_t i = 0; i < numJobs; i++) {
+    pthread_join(pt[i], NULL);
+    correct += jobs[i].correct;
+    incorrect += jobs[i].incorrect;
+    wrongpos += jobs[i].wrongpos;
+    ioErrors += jobs[i].ioErrors;
+  }
+  const double elapsed = timedouble() - start;
 
   fprintf(stderr,"*info* total %zd, correct %zd, incorrect %zd, wrong stored pos %zd, wrong thread uuid %zd\n", correct+incorrect+wrongpos+wronguuid, correct, incorrect, wrongpos, wronguuid);
+  fprintf(stderr,"*info* verified %.3lf GiB in %.1lf s (%.0lf MiB/s)\n", TOGiB(totalBytes), elapsed, elapsed > 0 ? TOMiB(totalBytes) / elapsed : 0);
 
-  free(buffer);
-  free(loadblock);
+  free(jobs);
+  free(pt);
+  free(items);
 
   positionContainerFree(&pc);
 
+  if (ioErrors) {
+    fprintf(stderr,"*error* %zd reads failed\n", ioErrors);
+    exit(-1);
+  }
 
   exit(0);
 }
-  
-  